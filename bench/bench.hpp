@@ -0,0 +1,150 @@
+// a small benchmark harness in the style of Google Benchmark
+//
+// Benchmarks are functions taking a bench::state, registered with BENCHMARK_ARGS (or BENCHMARK for
+// one without arguments) and timed inside a `for ( auto _ : state )` loop. Each runs for enough
+// iterations to fill the minimum time. Results can be written as JSON in Google Benchmark's
+// format, so runs from different commits can be compared with its tools/compare.py.
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+class state {
+public:
+    state( const int64_t arg, const size_t iterations ) noexcept:
+        _arg( arg ),
+        _iterations( iterations ) {
+    }
+
+    struct iterator {
+        // Marked unused so that `for ( auto _ : state )` doesn't warn
+        struct __attribute__( ( unused ) ) value {};
+
+        state * parent;
+        size_t remaining;
+
+        value operator*() const noexcept {
+            return {};
+        }
+
+        void operator++() noexcept {
+            --remaining;
+        }
+
+        // The timer stops when the loop runs out
+        bool operator!=( const iterator & ) const noexcept {
+            if ( remaining != 0 )
+                return true;
+            parent->stop();
+            return false;
+        }
+    };
+
+    // The timer starts when the loop does, so setup before it isn't counted
+    iterator begin() noexcept {
+        _start_real = std::chrono::steady_clock::now();
+        _start_cpu = std::clock();
+        return { this, _iterations };
+    }
+
+    iterator end() noexcept {
+        return { this, 0 };
+    }
+
+    // The benchmark's argument, e.g. a size or a count
+    int64_t range() const noexcept {
+        return _arg;
+    }
+
+    size_t iterations() const noexcept {
+        return _iterations;
+    }
+
+    // Totals over all the iterations, reported per second
+    void set_items_processed( const int64_t items ) noexcept {
+        _items = items;
+    }
+
+    void set_bytes_processed( const int64_t bytes ) noexcept {
+        _bytes = bytes;
+    }
+
+    int64_t items_processed() const noexcept {
+        return _items;
+    }
+
+    int64_t bytes_processed() const noexcept {
+        return _bytes;
+    }
+
+    double real_seconds() const noexcept {
+        return _real_seconds;
+    }
+
+    double cpu_seconds() const noexcept {
+        return _cpu_seconds;
+    }
+
+private:
+    void stop() noexcept {
+        const std::chrono::duration<double> real = std::chrono::steady_clock::now() - _start_real;
+        _real_seconds = real.count();
+        _cpu_seconds = double( std::clock() - _start_cpu ) / CLOCKS_PER_SEC;
+    }
+
+    int64_t _arg;
+    size_t _iterations;
+    int64_t _items = 0;
+    int64_t _bytes = 0;
+    std::chrono::steady_clock::time_point _start_real;
+    std::clock_t _start_cpu = 0;
+    double _real_seconds = 0.0;
+    double _cpu_seconds = 0.0;
+};
+
+struct benchmark {
+    std::string name;
+    std::function<void( state & )> function;
+    std::vector<int64_t> args; // run once per argument; empty for a single run without one
+};
+
+inline std::vector<benchmark> & registry() {
+    static std::vector<benchmark> benchmarks;
+    return benchmarks;
+}
+
+struct registrar {
+    registrar( const char * name,
+               std::function<void( state & )> function,
+               std::vector<int64_t> args = {} ) {
+        registry().push_back( { name, std::move( function ), std::move( args ) } );
+    }
+};
+
+// Keeps the compiler from optimizing away the computation of `value`
+template <class T> inline void do_not_optimize( const T & value ) noexcept {
+    asm volatile( "" : : "r,m"( value ) : "memory" );
+}
+
+// Makes everything written to memory so far count as used
+inline void clobber_memory() noexcept {
+    asm volatile( "" : : : "memory" );
+}
+
+} // namespace bench
+
+#define BENCH_CONCAT_IMPL( a, b ) a##b
+#define BENCH_CONCAT( a, b ) BENCH_CONCAT_IMPL( a, b )
+
+#define BENCHMARK( function )                                                                      \
+    static const bench::registrar BENCH_CONCAT( bench_registrar_, __LINE__ )( #function, function )
+
+#define BENCHMARK_ARGS( function, ... )                                                            \
+    static const bench::registrar BENCH_CONCAT( bench_registrar_, __LINE__ )( #function, function, \
+                                                                              { __VA_ARGS__ } )
@@ -0,0 +1,142 @@
+// benchmarks of whole tool flows: open, process and write a synthesized file, all in memory
+#include "bench.hpp"
+
+#include "breakpoint/breakpoint.hpp"
+#include "envx/envx.hpp"
+#include "sfenv/sfenv.hpp"
+#include "sfgain/sfgain.hpp"
+#include "sfpan/sfpan.hpp"
+#include "util/sndfile_utils.hpp"
+#include "util/virtual_io.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int sample_rate = 48000;
+constexpr sf_count_t file_frames = 10 * sample_rate;
+
+// The bytes of a float WAV of a few overlapping sines, made on first use. Kept in memory so that
+// the timings don't include the filesystem.
+const std::vector<std::byte> & synthesized( const int channels ) {
+    static std::vector<std::byte> files[2];
+    auto & file = files[channels - 1];
+    if ( file.empty() ) {
+        memory_stream stream;
+        {
+            SndfileHandle out( sound_stream::callbacks(), &stream, SFM_WRITE,
+                               SF_FORMAT_WAV | SF_FORMAT_FLOAT, channels, sample_rate );
+            std::vector<float> samples( file_frames * channels );
+            for ( sf_count_t f = 0; f < file_frames; ++f )
+                for ( int c = 0; c < channels; ++c )
+                    samples[f * channels + c] = float( 0.3 * std::sin( f * 0.013 * ( c + 1 ) )
+                                                       + 0.2 * std::sin( f * 0.0007 ) );
+            out.writef( samples.data(), file_frames );
+        }
+        file = stream.take();
+    }
+    return file;
+}
+
+// A point every 10 ms over the length of the file, in -1 to +1
+breakpoint::point_list make_points() {
+    breakpoint::point_list points;
+    for ( int i = 0; i <= 1000; ++i )
+        points.push_back( { i * 0.01, std::sin( i * 0.05 ) } );
+    return points;
+}
+
+void set_processed( bench::state & state, const int channels ) {
+    state.set_items_processed( int64_t( file_frames * state.iterations() ) );
+    state.set_bytes_processed(
+        int64_t( file_frames * channels * sizeof( float ) * state.iterations() ) );
+}
+
+void report_failure( const char * flow ) {
+    std::cout << flow << " failed; its timing is meaningless" << std::endl;
+}
+
+// The flows below read the in-memory input only through its handle, as they would stdin (see
+// is_stdio_path)
+const std::string in_memory = "-";
+
+// sfgain -a 0.5 on a stereo file
+void sfgain_flow( bench::state & state ) {
+    const auto & input = synthesized( 2 );
+    bool ok = true;
+    for ( auto _ : state ) {
+        memory_view in( input );
+        memory_stream out;
+        auto from = make_input_handle( in );
+        auto to = make_output_handle( out, from );
+        ok = ok && from && to && gain_copy( in_memory, *from, *to, 0.5f, false, 1 );
+    }
+    if ( !ok )
+        report_failure( "sfgain" );
+    set_processed( state, 2 );
+}
+BENCHMARK( sfgain_flow );
+
+// sfenv on a stereo file
+void sfenv_flow( bench::state & state ) {
+    const auto & input = synthesized( 2 );
+    const auto points = make_points();
+    const envelope_source source{ points, {} };
+    bool ok = true;
+    for ( auto _ : state ) {
+        memory_view in( input );
+        memory_stream out;
+        auto from = make_input_handle( in );
+        auto to = make_output_handle( out, from );
+        ok = ok && from && to && apply_breakpoints_impl( *from, *to, source, false );
+    }
+    if ( !ok )
+        report_failure( "sfenv" );
+    set_processed( state, 2 );
+}
+BENCHMARK( sfenv_flow );
+
+// sfpan of a mono file into stereo
+void sfpan_flow( bench::state & state ) {
+    const auto & input = synthesized( 1 );
+    const auto points = make_points();
+    bool ok = true;
+    for ( auto _ : state ) {
+        memory_view in( input );
+        memory_stream out;
+        auto from = make_input_handle( in );
+        auto to = make_output_handle( out, from, SF_INPUT_FORMAT, 2 );
+        ok = ok && from && to && pan_copy( *from, *to, points );
+    }
+    if ( !ok )
+        report_failure( "sfpan" );
+    set_processed( state, 1 );
+}
+BENCHMARK( sfpan_flow );
+
+// envx's default: the peak of each 15 ms window of a stereo file, channels summed
+void envx_flow( bench::state & state ) {
+    const auto & input = synthesized( 2 );
+    envelope_settings settings{};
+    settings.mode = envelope_mode::peak;
+    settings.win_ms = settings.hop_ms = 15;
+    settings.threads = 1;
+    bool ok = true;
+    for ( auto _ : state ) {
+        memory_view in( input );
+        auto from = make_input_handle( in );
+        auto points = from ? get_breakpoints( in_memory, *from, settings ) : std::nullopt;
+        ok = ok && points;
+        bench::do_not_optimize( points );
+    }
+    if ( !ok )
+        report_failure( "envx" );
+    set_processed( state, 2 );
+}
+BENCHMARK( envx_flow );
+
+} // namespace
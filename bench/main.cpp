@@ -0,0 +1,160 @@
+// runs the registered benchmarks and reports them on the console and optionally as JSON
+#include "bench.hpp"
+
+#include "util/simple_options.hpp"
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct result {
+    std::string name;
+    size_t iterations;
+    double real_ns; // per iteration
+    double cpu_ns;
+    double items_per_second; // 0 if not set
+    double bytes_per_second;
+};
+
+// Runs `b` with more and more iterations until a run takes at least `min_time` seconds
+result run( const bench::benchmark & b, const int64_t arg, const std::string & name,
+            const double min_time ) {
+    size_t iterations = 1;
+    for ( ;; ) {
+        bench::state state( arg, iterations );
+        b.function( state );
+        const double seconds = state.real_seconds();
+        if ( seconds >= min_time || iterations >= 1'000'000'000 ) {
+            auto per_second = [seconds]( int64_t total ) {
+                return total && seconds > 0.0 ? double( total ) / seconds : 0.0;
+            };
+            return { name,
+                     iterations,
+                     seconds * 1e9 / double( iterations ),
+                     state.cpu_seconds() * 1e9 / double( iterations ),
+                     per_second( state.items_processed() ),
+                     per_second( state.bytes_processed() ) };
+        }
+
+        // Aim a bit past the minimum, but don't grow more than tenfold on a noisy short run
+        const double factor = seconds > 0.0 ? std::min( 10.0, min_time * 1.4 / seconds ) : 10.0;
+        iterations = std::max( iterations + 1, size_t( double( iterations ) * factor ) );
+    }
+}
+
+void print( const result & r ) {
+    std::cout << std::left << std::setw( 40 ) << r.name << std::right << std::setw( 14 )
+              << std::fixed << std::setprecision( 1 ) << r.real_ns << " ns" << std::setw( 14 )
+              << r.cpu_ns << " ns" << std::setw( 12 ) << r.iterations;
+    if ( r.items_per_second > 0.0 )
+        std::cout << std::setw( 12 ) << std::setprecision( 3 ) << r.items_per_second / 1e6
+                  << " M items/s";
+    if ( r.bytes_per_second > 0.0 )
+        std::cout << std::setw( 12 ) << std::setprecision( 3 ) << r.bytes_per_second / 1e6
+                  << " MB/s";
+    std::cout << std::endl;
+}
+
+// Same layout as Google Benchmark's --benchmark_format=json
+void write_json( std::ostream & os, const std::vector<result> & results, const char * executable ) {
+    char date[64];
+    const std::time_t now = std::time( nullptr );
+    std::strftime( date, sizeof( date ), "%Y-%m-%dT%H:%M:%S%z", std::localtime( &now ) );
+
+    os << std::setprecision( 10 );
+    os << "{\n  \"context\": {\n";
+    os << "    \"date\": \"" << date << "\",\n";
+    os << "    \"executable\": \"" << executable << "\",\n";
+    os << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+#ifdef NDEBUG
+    os << "    \"library_build_type\": \"release\"\n";
+#else
+    os << "    \"library_build_type\": \"debug\"\n";
+#endif
+    os << "  },\n  \"benchmarks\": [\n";
+    for ( size_t i = 0; i < results.size(); ++i ) {
+        const auto & r = results[i];
+        os << "    {\n";
+        os << "      \"name\": \"" << r.name << "\",\n";
+        os << "      \"run_name\": \"" << r.name << "\",\n";
+        os << "      \"run_type\": \"iteration\",\n";
+        os << "      \"iterations\": " << r.iterations << ",\n";
+        os << "      \"real_time\": " << r.real_ns << ",\n";
+        os << "      \"cpu_time\": " << r.cpu_ns << ",\n";
+        os << "      \"time_unit\": \"ns\"";
+        if ( r.items_per_second > 0.0 )
+            os << ",\n      \"items_per_second\": " << r.items_per_second;
+        if ( r.bytes_per_second > 0.0 )
+            os << ",\n      \"bytes_per_second\": " << r.bytes_per_second;
+        os << "\n    }" << ( i + 1 < results.size() ? "," : "" ) << "\n";
+    }
+    os << "  ]\n}\n";
+}
+
+} // namespace
+
+int main( int argc, char ** argv ) {
+    simple_options::options opts{ "bench", "Run the micro and macro benchmarks" };
+    std::string json_path, filter;
+    double min_time;
+    opts.basic_option( "help,h", "Print description and exit" )
+        .basic_option( "list", "Print the names of the benchmarks and exit" )
+        .stored_option( "filter,f", "Only run benchmarks whose names contain this", &filter )
+        .basic_option( "min-time", "Minimum time to run each benchmark for, in seconds",
+                       simple_options::defaulted_value( &min_time, 0.5 ) )
+        .stored_option( "json", "Also write the results to this file as JSON", &json_path )
+        .parse( argc, argv );
+
+    if ( opts.has( "help" ) ) {
+        std::cout << opts;
+        return 0;
+    }
+
+    std::vector<std::pair<const bench::benchmark *, int64_t>> runs;
+    std::vector<std::string> names;
+    for ( const auto & b : bench::registry() ) {
+        const bool has_args = !b.args.empty();
+        for ( size_t i = 0; i < std::max<size_t>( b.args.size(), 1 ); ++i ) {
+            const int64_t arg = has_args ? b.args[i] : 0;
+            auto name = has_args ? b.name + "/" + std::to_string( arg ) : b.name;
+            if ( name.find( filter ) == std::string::npos )
+                continue;
+            runs.push_back( { &b, arg } );
+            names.push_back( std::move( name ) );
+        }
+    }
+
+    if ( opts.has( "list" ) ) {
+        for ( const auto & name : names )
+            std::cout << name << std::endl;
+        return 0;
+    }
+
+    std::cout << std::left << std::setw( 40 ) << "Benchmark" << std::right << std::setw( 17 )
+              << "Time" << std::setw( 17 ) << "CPU" << std::setw( 12 ) << "Iterations"
+              << std::endl;
+    std::cout << std::string( 86, '-' ) << std::endl;
+
+    std::vector<result> results;
+    for ( size_t i = 0; i < runs.size(); ++i ) {
+        results.push_back( run( *runs[i].first, runs[i].second, names[i], min_time ) );
+        print( results.back() );
+    }
+
+    if ( !json_path.empty() ) {
+        std::ofstream out( json_path );
+        write_json( out, results, argv[0] );
+        if ( !out ) {
+            std::cout << "Could not write " << json_path << std::endl;
+            return 2;
+        }
+    }
+    return 0;
+}
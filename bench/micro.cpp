@@ -0,0 +1,140 @@
+// benchmarks of the inner loops on their own
+#include "bench.hpp"
+
+#include "breakpoint/breakpoint.hpp"
+#include "util/audio_kernels.hpp"
+#include "util/basic_envelope_generator.hpp"
+#include "util/pan_utils.hpp"
+#include "util/sndfile_utils.hpp"
+#include "util/stereo_envelope_generator.hpp"
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t sample_rate = 48000;
+constexpr size_t block_frames = 1024;
+
+// Signal-like values in -1 to +1
+std::vector<float> make_signal( const size_t n ) {
+    std::vector<float> result( n );
+    for ( size_t i = 0; i < n; ++i )
+        result[i] = float( std::sin( double( i ) * 0.01 ) );
+    return result;
+}
+
+// A point every `frames_per_point` frames over about a million frames, with values in -1 to +1 so
+// they also work as pan positions
+breakpoint::point_list make_points( const int64_t frames_per_point ) {
+    breakpoint::point_list points;
+    const size_t count = std::max<size_t>( 2, ( 1 << 20 ) / frames_per_point );
+    for ( size_t i = 0; i < count; ++i )
+        points.push_back( { double( i * frames_per_point ) / sample_rate,
+                            std::sin( double( i ) * 0.7 ) } );
+    return points;
+}
+
+void parse_breakpoints( bench::state & state ) {
+    std::string text;
+    for ( int64_t i = 0; i < state.range(); ++i )
+        text += std::to_string( i * 0.01 ) + "\t" + std::to_string( std::sin( i * 0.1 ) ) + "\n";
+
+    for ( auto _ : state ) {
+        auto result = breakpoint::parse_breakpoints_text( text );
+        bench::do_not_optimize( result );
+    }
+    state.set_items_processed( state.range() * state.iterations() );
+    state.set_bytes_processed( int64_t( text.size() * state.iterations() ) );
+}
+BENCHMARK_ARGS( parse_breakpoints, 1000, 100000 );
+
+// Renders blocks from the start of the envelope to its end and round again
+template <class Generator> void render_envelope( bench::state & state ) {
+    const auto points = make_points( state.range() );
+    const size_t total_frames = size_t( points.back().time_secs * sample_rate );
+    Generator gen( points, sample_rate, block_frames );
+
+    size_t position = 0;
+    for ( auto _ : state ) {
+        if ( position >= total_frames ) {
+            gen.seek( 0 );
+            position = 0;
+        }
+        auto frames = gen.next_frames( block_frames );
+        bench::do_not_optimize( frames.data() );
+        position += block_frames;
+    }
+    state.set_items_processed( int64_t( block_frames * state.iterations() ) );
+}
+
+void basic_envelope_next_frames( bench::state & state ) {
+    render_envelope<basic_envelope_generator>( state );
+}
+BENCHMARK_ARGS( basic_envelope_next_frames, 4, 64, 4096 );
+
+void stereo_envelope_next_frames( bench::state & state ) {
+    render_envelope<stereo_envelope_generator>( state );
+}
+BENCHMARK_ARGS( stereo_envelope_next_frames, 4, 64, 4096 );
+
+std::vector<float> make_positions() {
+    std::vector<float> positions( block_frames );
+    for ( size_t i = 0; i < block_frames; ++i )
+        positions[i] = -1.f + 2.f * float( i ) / float( block_frames - 1 );
+    return positions;
+}
+
+void pan_constant_power( bench::state & state ) {
+    const auto positions = make_positions();
+    for ( auto _ : state ) {
+        for ( auto position : positions ) {
+            auto pair = constant_power_pan<float>( position );
+            bench::do_not_optimize( pair );
+        }
+    }
+    state.set_items_processed( int64_t( block_frames * state.iterations() ) );
+}
+BENCHMARK( pan_constant_power );
+
+void pan_law_table_lookup( bench::state & state ) {
+    const auto positions = make_positions();
+    std::vector<float> gains( block_frames * 2 );
+    const auto & table = pan_law_table::standard();
+    for ( auto _ : state ) {
+        table.pan( positions, gains );
+        bench::clobber_memory();
+    }
+    state.set_items_processed( int64_t( block_frames * state.iterations() ) );
+}
+BENCHMARK( pan_law_table_lookup );
+
+// The transform behind scale_copy, on a stereo block. The gain keeps the samples' size, so that
+// repeating it never reaches denormals.
+void scale_transform( bench::state & state ) {
+    auto samples = make_signal( block_frames * 2 );
+    auto scale = scale_by( -1.f );
+    for ( auto _ : state ) {
+        scale( std::span<float>( samples ) );
+        bench::clobber_memory();
+    }
+    state.set_bytes_processed( int64_t( samples.size() * sizeof( float ) * state.iterations() ) );
+}
+BENCHMARK( scale_transform );
+
+// What sfenv's multichan_multiply does to each block, by channel count
+void multichan_multiply( bench::state & state ) {
+    const auto channels = int( state.range() );
+    auto samples = make_signal( block_frames * channels );
+    const std::vector<float> gains( block_frames, -1.f ); // as in scale_transform
+    for ( auto _ : state ) {
+        audio_kernels::apply_gain_envelope( samples, gains, channels );
+        bench::clobber_memory();
+    }
+    state.set_items_processed( int64_t( block_frames * state.iterations() ) );
+    state.set_bytes_processed( int64_t( samples.size() * sizeof( float ) * state.iterations() ) );
+}
+BENCHMARK_ARGS( multichan_multiply, 1, 2, 3, 6, 8 );
+
+} // namespace
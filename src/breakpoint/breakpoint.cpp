@@ -1,11 +1,14 @@
 #include "breakpoint/breakpoint.hpp"
 
-#include <cassert>
+#include <bit>
 #include <charconv>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <istream>
 #include <ostream>
+#include <sstream>
 
 namespace breakpoint {
 
@@ -43,108 +46,174 @@ std::ostream & operator<<( std::ostream & os, parse_error::errc code ) {
 // Max line length
 static constexpr unsigned maxlen = 256u;
 
+static std::string_view as_text( const mapped_file & file ) noexcept {
+    return { reinterpret_cast<const char *>( file.bytes().data() ), file.bytes().size() };
+}
+
 // Performs following validations:
 // - should be at least two points
 // - times should be increasing
 // - first time should be 0.0
 //
+// `line_of( i )` gives the line to report for the point at index i.
 // Returns {error+line num} or {success+0}
-static parse_error validate_breakpoints( const point_list & points,
-                                         const std::vector<unsigned> & line_nums,
+template <typename LineOf>
+static parse_error validate_breakpoints( std::span<const point> points,
+                                         LineOf && line_of,
                                          unsigned last_line ) {
-    assert( points.size() == line_nums.size() );
-
     if ( points.size() < 2 )
         return { parse_error::at_least_two_points, last_line };
 
     if ( points[0].time_secs != 0.0 )
-        return { parse_error::first_time_not_zero, line_nums[0] };
+        return { parse_error::first_time_not_zero, line_of( 0 ) };
 
     auto it = std::adjacent_find( begin( points ), end( points ),
                                   []( point l, point r ) { return l.time_secs >= r.time_secs; } );
     if ( it != end( points ) )
-        return { parse_error::time_not_increasing, line_nums[it - points.begin()] };
+        return { parse_error::time_not_increasing, line_of( it - points.begin() ) };
 
     return { parse_error::success, 0 };
 }
 
+// strtod on a terminated copy of [column, end), for what from_chars doesn't accept: a leading '+',
+// hex values and values out of range. Returns past the end of the double.
+static const char * parse_double_fallback( const char * column,
+                                           const char * end,
+                                           double & out ) noexcept {
+    char copy[maxlen + 1];
+    const size_t n = size_t( end - column );
+    std::memcpy( copy, column, n );
+    copy[n] = '\0';
+
+    char * str_end;
+    out = std::strtod( copy, &str_end );
+    return column + ( str_end - copy );
+}
+
 // Returns whether or not parsing was successful
 // If successful, column is set to past end of double, out is set to double value
-static bool try_parse_double( const char *& column, double & out ) noexcept {
-    char * str_end;
-    out = std::strtod( column, &str_end );
-    if ( str_end == column || out == HUGE_VAL )
+static bool try_parse_double( const char *& column, const char * end, double & out ) noexcept {
+    auto [ptr, ec] = std::from_chars( column, end, out );
+    if ( ec != std::errc() || ( ptr != end && ( *ptr == 'x' || *ptr == 'X' ) ) )
+        ptr = parse_double_fallback( column, end, out );
+    if ( ptr == column || out == HUGE_VAL )
         return false;
-    column = str_end;
+    column = ptr;
     return true;
 }
 
 // Eat up spaces and tabs
-static inline const char * scan_to_next_token( const char * column ) noexcept {
-    while ( *column != '\0' && ( *column == ' ' || *column == '\t' ) )
+static inline const char * scan_to_next_token( const char * column, const char * end ) noexcept {
+    while ( column != end && ( *column == ' ' || *column == '\t' ) )
         column++;
     return column;
 }
 
+// 1-based line number of the line containing `p`
+static unsigned line_number( std::string_view text, const char * p ) noexcept {
+    return unsigned( 1 + std::count( text.data(), p, '\n' ) );
+}
+
+// 1-based line number of the `index`th point, found by scanning the lines again
+static unsigned line_of_point( std::string_view text, size_t index ) noexcept {
+    const char * line = text.data();
+    const char * const end = line + text.size();
+    for ( unsigned line_count = 1;; ++line_count ) {
+        auto * newline =
+            static_cast<const char *>( std::memchr( line, '\n', size_t( end - line ) ) );
+        if ( scan_to_next_token( line, newline ) != newline && index-- == 0 )
+            return line_count;
+        line = newline + 1;
+    }
+}
+
 std::variant<point_list, parse_error> parse_breakpoints( std::istream & is ) {
     if ( !is )
         return { parse_error{ parse_error::io_error, 0 } };
-    if ( is.peek() == std::istream::traits_type::eof() )
-        return parse_error{ parse_error::unexpected_eof, 1 };
 
-    unsigned line_count = 0;
-    point_list result;
-    std::vector<unsigned> line_nums;
-    while ( true ) {
-        // Only successful exit path from this function
-        if ( is.peek() == std::istream::traits_type::eof() ) {
-            auto && validate_error = validate_breakpoints( result, line_nums, line_count );
-            using ReturnT = decltype( parse_breakpoints( is ) );
-            return validate_error.code == parse_error::success ? ReturnT{ result } : validate_error;
-        }
+    std::ostringstream text;
+    if ( is.peek() != std::istream::traits_type::eof() )
+        text << is.rdbuf();
+    if ( is.bad() )
+        return { parse_error{ parse_error::io_error, 0 } };
+    return parse_breakpoints_text( text.view() );
+}
+
+// What was found on one line of text
+struct text_line {
+    parse_error::errc code;
+    std::optional<point> found; // empty for an empty line
+    const char * next;          // start of the following line
+};
 
-        ++line_count;
-        char line[maxlen + 1];
-        is.getline( line, maxlen + 1 );
-        if ( is.eof() )
-            return parse_error{ parse_error::unexpected_eof, line_count };
-        if ( is.fail() )
-            return parse_error{ is.gcount() == maxlen ? parse_error::line_too_long
-                                                      : parse_error::io_error,
-                                line_count };
+// Reads the line starting at `line`, which must not be `end`
+static text_line read_line( const char * line, const char * end ) noexcept {
+    auto * newline = static_cast<const char *>( std::memchr( line, '\n', size_t( end - line ) ) );
+    auto * line_end = newline ? newline : end;
+    if ( line_end - line > maxlen )
+        return { parse_error::line_too_long, std::nullopt, end };
+    if ( !newline )
+        return { parse_error::unexpected_eof, std::nullopt, end };
 
-        // Process each line
-        auto * column = scan_to_next_token( line );
-        if ( *column == '\0' )
-            continue; // skip empty lines
+    auto * column = scan_to_next_token( line, line_end );
+    if ( column == line_end )
+        return { parse_error::success, std::nullopt, newline + 1 }; // empty line
 
-        // Time
-        point this_point;
-        if ( !try_parse_double( column, this_point.time_secs ) )
-            return parse_error{ parse_error::misformatted_line, line_count };
+    const text_line misformatted{ parse_error::misformatted_line, std::nullopt, end };
 
-        auto * next = scan_to_next_token( column );
+    // Time
+    point this_point;
+    if ( !try_parse_double( column, line_end, this_point.time_secs ) )
+        return misformatted;
 
-        if ( column == next )
-            return parse_error{ parse_error::misformatted_line, line_count };
-        column = next;
+    auto * next = scan_to_next_token( column, line_end );
 
-        // Value
-        if ( !try_parse_double( column, this_point.value ) )
-            return parse_error{ parse_error::misformatted_line, line_count };
+    if ( column == next )
+        return misformatted;
+    column = next;
 
-        column = scan_to_next_token( column );
+    // Value
+    if ( !try_parse_double( column, line_end, this_point.value ) )
+        return misformatted;
 
-        if ( *column != '\0' )
-            return parse_error{ parse_error::misformatted_line, line_count };
+    column = scan_to_next_token( column, line_end );
 
-        // Success
-        result.push_back( this_point );
-        line_nums.push_back( line_count );
+    if ( column != line_end )
+        return misformatted;
+
+    return { parse_error::success, this_point, newline + 1 };
+}
+
+std::variant<point_list, parse_error> parse_breakpoints_text( std::string_view text ) noexcept {
+    if ( text.empty() )
+        return parse_error{ parse_error::unexpected_eof, 1 };
+
+    // Line numbers are only worked out when there is an error to report
+    point_list result;
+    const char * line = text.data();
+    const char * const end = line + text.size();
+    while ( line != end ) {
+        auto read = read_line( line, end );
+        if ( read.code != parse_error::success )
+            return parse_error{ read.code, line_number( text, line ) };
+        if ( read.found )
+            result.push_back( *read.found );
+        line = read.next;
     }
+
+    auto && validate_error = validate_breakpoints(
+        result, [text]( size_t i ) { return line_of_point( text, i ); },
+        line_number( text, end ) - 1 );
+    using ReturnT = decltype( parse_breakpoints_text( text ) );
+    return validate_error.code == parse_error::success ? ReturnT{ std::move( result ) }
+                                                       : validate_error;
 }
 
 std::variant<point_list, parse_error> parse_breakpoints( const std::string & path ) noexcept {
+    if ( mapped_file file( path ); file )
+        return parse_breakpoints_text( as_text( file ) );
+
+    // Empty files can't be mapped, but still need to be told apart from missing ones
     std::ifstream ifs{ path };
     return ifs.is_open() ? parse_breakpoints( ifs ) : parse_error{ parse_error::io_error, 0 };
 }
@@ -160,4 +229,274 @@ bool write_breakpoints( const std::string & path, const point_list & points ) no
     return ofs.is_open() && write_breakpoints( ofs, points );
 }
 
+point_list simplify( std::span<const point> points, const double tolerance ) {
+    if ( points.size() < 3 )
+        return point_list( points.begin(), points.end() );
+
+    // Segments still to be checked are kept on a stack rather than recursed into, so long
+    // envelopes can't run out of stack.
+    std::vector<bool> keep( points.size(), false );
+    keep.front() = keep.back() = true;
+    std::vector<std::pair<size_t, size_t>> segments{ { 0, points.size() - 1 } };
+    while ( !segments.empty() ) {
+        const auto [first, last] = segments.back();
+        segments.pop_back();
+        if ( last - first < 2 )
+            continue;
+
+        // Error is measured in value at the same time, since that is what rendering would be off
+        // by. Every point between `first` and `last` is a candidate, even one right on the line,
+        // so that a negative tolerance keeps everything rather than splitting forever.
+        const point a = points[first];
+        const point b = points[last];
+        const double slope = ( b.value - a.value ) / ( b.time_secs - a.time_secs );
+        double worst = -1.0;
+        size_t worst_index = first;
+        for ( size_t i = first + 1; i < last; ++i ) {
+            const double line = a.value + slope * ( points[i].time_secs - a.time_secs );
+            const double error = std::abs( points[i].value - line );
+            if ( error > worst ) {
+                worst = error;
+                worst_index = i;
+            }
+        }
+
+        if ( worst_index != first && worst > tolerance ) {
+            keep[worst_index] = true;
+            segments.push_back( { first, worst_index } );
+            segments.push_back( { worst_index, last } );
+        }
+    }
+
+    point_list result;
+    for ( size_t i = 0; i < points.size(); ++i ) {
+        if ( keep[i] )
+            result.push_back( points[i] );
+    }
+    return result;
+}
+
+// Binary format
+
+static constexpr char binary_magic[8] = { 'T', 'A', 'P', 'B', 'B', 'K', 'P', 'T' };
+static constexpr uint32_t binary_version = 1;
+static constexpr size_t binary_header_size = 24;
+
+template <typename T> static T read_le( const std::byte * p ) noexcept {
+    using bits_t = std::conditional_t<sizeof( T ) == 8, uint64_t, uint32_t>;
+    bits_t bits = 0;
+    for ( size_t i = 0; i < sizeof( T ); ++i )
+        bits |= bits_t( p[i] ) << ( 8 * i );
+    return std::bit_cast<T>( bits );
+}
+
+template <typename T> static void write_le( std::ostream & os, T value ) {
+    using bits_t = std::conditional_t<sizeof( T ) == 8, uint64_t, uint32_t>;
+    auto bits = std::bit_cast<bits_t>( value );
+    char bytes[sizeof( T )];
+    for ( size_t i = 0; i < sizeof( T ); ++i )
+        bytes[i] = char( ( bits >> ( 8 * i ) ) & 0xff );
+    os.write( bytes, sizeof( T ) );
+}
+
+static bool has_binary_magic( std::span<const std::byte> bytes ) noexcept {
+    return bytes.size() >= sizeof( binary_magic )
+        && std::memcmp( bytes.data(), binary_magic, sizeof( binary_magic ) ) == 0;
+}
+
+// The `index`th point of a binary file, `data` being the start of the points
+template <typename T> static point read_point( const std::byte * data, uint64_t index ) noexcept {
+    return { read_le<T>( data + ( 2 * index ) * sizeof( T ) ),
+             read_le<T>( data + ( 2 * index + 1 ) * sizeof( T ) ) };
+}
+
+template <typename T>
+static point_list convert_points( const std::byte * data, uint64_t count ) noexcept {
+    point_list result( count );
+    for ( uint64_t i = 0; i < count; ++i )
+        result[i] = read_point<T>( data, i );
+    return result;
+}
+
+struct binary_header {
+    binary_precision precision;
+    uint64_t count;
+};
+
+// Checks the header, and that the file is long enough to hold the points it promises
+static std::variant<binary_header, parse_error> read_binary_header(
+    std::span<const std::byte> bytes ) noexcept {
+    if ( bytes.size() < binary_header_size || !has_binary_magic( bytes ) )
+        return parse_error{ parse_error::misformatted_line, 0 };
+
+    const auto version = read_le<uint32_t>( bytes.data() + 8 );
+    const auto precision = binary_precision( read_le<uint32_t>( bytes.data() + 12 ) );
+    const auto count = read_le<uint64_t>( bytes.data() + 16 );
+    if ( version != binary_version
+         || ( precision != binary_precision::float64 && precision != binary_precision::float32 ) )
+        return parse_error{ parse_error::misformatted_line, 0 };
+
+    const size_t sample_size = precision == binary_precision::float64 ? 8 : 4;
+    const size_t available = ( bytes.size() - binary_header_size ) / ( 2 * sample_size );
+    if ( count > available )
+        return parse_error{ parse_error::unexpected_eof, unsigned( available + 1 ) };
+
+    return binary_header{ precision, count };
+}
+
+std::variant<breakpoint_file, parse_error> read_breakpoints_binary( mapped_file file ) noexcept {
+    auto header = read_binary_header( file.bytes() );
+    if ( auto * perr = std::get_if<parse_error>( &header ) )
+        return *perr;
+    const auto [precision, count] = std::get<binary_header>( header );
+
+    const std::byte * data = file.bytes().data() + binary_header_size;
+    const bool in_place = precision == binary_precision::float64
+        && std::endian::native == std::endian::little && sizeof( point ) == 16
+        && reinterpret_cast<uintptr_t>( data ) % alignof( point ) == 0;
+
+    auto result = in_place
+        ? breakpoint_file( std::move( file ),
+                           { reinterpret_cast<const point *>( data ), size_t( count ) } )
+        : breakpoint_file( precision == binary_precision::float64
+                               ? convert_points<double>( data, count )
+                               : convert_points<float>( data, count ) );
+
+    auto validate_error = validate_breakpoints(
+        result.points(), []( size_t i ) { return unsigned( i + 1 ); }, unsigned( count ) );
+    if ( validate_error.code != parse_error::success )
+        return validate_error;
+    return result;
+}
+
+std::variant<breakpoint_file, parse_error> read_breakpoints( const std::string & path ) noexcept {
+    mapped_file file( path );
+    if ( file && has_binary_magic( file.bytes() ) )
+        return read_breakpoints_binary( std::move( file ) );
+
+    auto parsed = file ? parse_breakpoints_text( as_text( file ) ) : parse_breakpoints( path );
+    if ( auto * perr = std::get_if<parse_error>( &parsed ) )
+        return *perr;
+    return breakpoint_file( std::move( std::get<point_list>( parsed ) ) );
+}
+
+bool write_breakpoints_binary( std::ostream & os,
+                               std::span<const point> points,
+                               binary_precision precision ) {
+    os.write( binary_magic, sizeof( binary_magic ) );
+    write_le( os, binary_version );
+    write_le( os, uint32_t( precision ) );
+    write_le( os, uint64_t( points.size() ) );
+    for ( auto & point : points ) {
+        if ( precision == binary_precision::float64 ) {
+            write_le( os, point.time_secs );
+            write_le( os, point.value );
+        } else {
+            write_le( os, float( point.time_secs ) );
+            write_le( os, float( point.value ) );
+        }
+    }
+    return bool( os );
+}
+
+bool write_breakpoints_binary( const std::string & path,
+                               std::span<const point> points,
+                               binary_precision precision ) noexcept {
+    std::ofstream ofs{ path, std::ios::binary };
+    return ofs.is_open() && write_breakpoints_binary( ofs, points, precision );
+}
+
+// point_stream
+
+point_stream::point_stream( const std::string & path ) noexcept: _file( path ) {
+    if ( !_file ) {
+        // Empty files can't be mapped, but still need to be told apart from missing ones
+        _open_error = std::ifstream{ path }.is_open()
+            ? parse_error{ parse_error::unexpected_eof, 1 }
+            : parse_error{ parse_error::io_error, 0 };
+    } else if ( has_binary_magic( _file.bytes() ) ) {
+        auto header = read_binary_header( _file.bytes() );
+        if ( auto * perr = std::get_if<parse_error>( &header ) ) {
+            _open_error = *perr;
+        } else {
+            _binary = true;
+            _precision = std::get<binary_header>( header ).precision;
+            _count = std::get<binary_header>( header ).count;
+        }
+    }
+
+    _file.advise_sequential();
+    rewind();
+}
+
+void point_stream::rewind() noexcept {
+    _error = _open_error;
+    _done = false;
+    _position = 0;
+    _points_read = 0;
+}
+
+std::optional<point> point_stream::next() noexcept {
+    if ( _done || _error.code != parse_error::success )
+        return std::nullopt;
+
+    if ( _binary ) {
+        if ( _position == _count )
+            return finish( unsigned( _count ) );
+
+        const std::byte * data = _file.bytes().data() + binary_header_size;
+        const size_t index = _position++;
+        return accept( _precision == binary_precision::float64 ? read_point<double>( data, index )
+                                                               : read_point<float>( data, index ),
+                       index );
+    }
+
+    const auto text = as_text( _file );
+    const char * const end = text.data() + text.size();
+    while ( _position != text.size() ) {
+        const char * line = text.data() + _position;
+        auto read = read_line( line, end );
+        if ( read.code != parse_error::success )
+            return fail( read.code, line_number( text, line ) );
+
+        _position = size_t( read.next - text.data() );
+        if ( read.found )
+            return accept( *read.found, size_t( line - text.data() ) );
+    }
+
+    return finish( line_number( text, end ) - 1 );
+}
+
+std::optional<point> point_stream::accept( const point p, const size_t position ) noexcept {
+    if ( _points_read == 0 && p.time_secs != 0.0 )
+        return fail( parse_error::first_time_not_zero, line_at( position ) );
+    if ( _points_read > 0 && p.time_secs <= _previous.time_secs )
+        return fail( parse_error::time_not_increasing, line_at( _previous_position ) );
+
+    ++_points_read;
+    _previous = p;
+    _previous_position = position;
+    return p;
+}
+
+std::optional<point> point_stream::finish( const unsigned last_line ) noexcept {
+    _done = true;
+    if ( _points_read < 2 )
+        _error = { parse_error::at_least_two_points, last_line };
+    return std::nullopt;
+}
+
+std::optional<point> point_stream::fail( const parse_error::errc code,
+                                         const unsigned line ) noexcept {
+    _error = { code, line };
+    return std::nullopt;
+}
+
+unsigned point_stream::line_at( const size_t position ) const noexcept {
+    if ( _binary )
+        return unsigned( position + 1 );
+    const auto text = as_text( _file );
+    return line_number( text, text.data() + position );
+}
+
 } // namespace breakpoint
@@ -1,7 +1,15 @@
 // Breakpoint utility library
 #pragma once
 
+#include "util/mapped_file.hpp"
+
+#include <algorithm>
+#include <cstdint>
 #include <iosfwd>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -57,6 +65,10 @@ std::ostream & operator<<( std::ostream & os, parse_error::errc code );
 // - line can be a maximum of 256 characters long
 std::variant<point_list, parse_error> parse_breakpoints( std::istream & is );
 
+// Parses a whole file's worth of text already in memory, in the format above. This is what the
+// other overloads end up calling.
+std::variant<point_list, parse_error> parse_breakpoints_text( std::string_view text ) noexcept;
+
 // Helper function -- tries to open file at `path`, if it fails then return {io_error,0}
 std::variant<point_list, parse_error> parse_breakpoints( const std::string & path ) noexcept;
 
@@ -68,6 +80,114 @@ bool write_breakpoints( std::ostream & os, const point_list & points );
 // return false.
 bool write_breakpoints( const std::string & path, const point_list & points ) noexcept;
 
+// Binary file format:
+//
+// a 24-byte header followed by the points, all little-endian.
+// header: magic "TAPBBKPT" (8 bytes), version (uint32, currently 1), sample type (uint32, see
+//         binary_precision), point count (uint64)
+// points: count pairs of time then value, each a double or a float depending on the sample type
+//
+// The same rules apply as for the text format, except that there are no lines: errors report the
+// 1-based index of the offending point as the line, or 0 if the header is bad.
+enum class binary_precision : uint32_t { float64 = 0, float32 = 1 };
+
+// Breakpoints loaded from a file. Binary files of doubles are used in place, straight out of a
+// memory mapping; anything else is parsed or converted into memory owned by this object.
+class breakpoint_file {
+public:
+    explicit breakpoint_file( point_list points ) noexcept:
+        _owned( std::move( points ) ),
+        _points( _owned ) {
+    }
+
+    breakpoint_file( mapped_file file, std::span<const point> points ) noexcept:
+        _file( std::move( file ) ),
+        _points( points ) {
+    }
+
+    // Movable, since neither the mapping nor the vector's storage moves with it.
+    breakpoint_file( breakpoint_file && ) noexcept = default;
+    breakpoint_file & operator=( breakpoint_file && ) noexcept = default;
+
+    std::span<const point> points() const noexcept {
+        return _points;
+    }
+
+private:
+    mapped_file _file;
+    point_list _owned;
+    std::span<const point> _points;
+};
+
+// Reads a breakpoint file in either format, telling them apart by the binary magic number.
+std::variant<breakpoint_file, parse_error> read_breakpoints( const std::string & path ) noexcept;
+
+// Reads the points of a breakpoint file in either format one at a time, checking them as it goes,
+// so that an envelope of any length can be used in constant memory. The file is mapped rather than
+// loaded. Unlike parse_breakpoints, this reports the first problem it comes to, which for a file
+// with several problems may not be the one parse_breakpoints would report.
+class point_stream {
+public:
+    // If the file can't be opened, or has a bad binary header, error() says so and there are no
+    // points.
+    explicit point_stream( const std::string & path ) noexcept;
+
+    point_stream( point_stream && ) noexcept = default;
+    point_stream & operator=( point_stream && ) noexcept = default;
+
+    // The next point, or nullopt at the end of the file or at the first problem. Once this has
+    // returned nullopt, error() tells whether the whole file was valid.
+    std::optional<point> next() noexcept;
+
+    // Starts again from the first point.
+    void rewind() noexcept;
+
+    // {success, 0} if no problem has been found so far.
+    parse_error error() const noexcept {
+        return _error;
+    }
+
+private:
+    std::optional<point> accept( point p, size_t position ) noexcept;
+    std::optional<point> finish( unsigned last_line ) noexcept;
+    std::optional<point> fail( parse_error::errc code, unsigned line ) noexcept;
+    unsigned line_at( size_t position ) const noexcept;
+
+    mapped_file _file;
+    parse_error _open_error{ parse_error::success, 0 };
+    parse_error _error{ parse_error::success, 0 };
+    bool _binary = false;
+    binary_precision _precision = binary_precision::float64;
+    uint64_t _count = 0;
+    bool _done = false;
+    // Text: offset of the next line. Binary: index of the next point.
+    size_t _position = 0;
+    size_t _points_read = 0;
+    point _previous{ 0.0, 0.0 };
+    size_t _previous_position = 0;
+};
+
+// Reads the binary format out of a mapping of the whole file. The mapping is handed over to the
+// result if the points can be used in place.
+std::variant<breakpoint_file, parse_error> read_breakpoints_binary( mapped_file file ) noexcept;
+
+// Writes breakpoints in the binary format, without any validation. Returns whether or not the
+// operation succeeded.
+bool write_breakpoints_binary( std::ostream & os,
+                               std::span<const point> points,
+                               binary_precision precision = binary_precision::float64 );
+
+// Convenience function -- tries to open file at `path` and write breakpoints in the binary format,
+// if it fails then return false.
+bool write_breakpoints_binary( const std::string & path,
+                               std::span<const point> points,
+                               binary_precision precision = binary_precision::float64 ) noexcept;
+
+// Drops points from `points` (Ramer-Douglas-Peucker) so that, with straight lines between the
+// points that are left, no dropped point's value is off by more than `tolerance`. The first and
+// last points are always kept. Times must be increasing.
+point_list simplify( std::span<const point> points, double tolerance );
+
 template <typename FwdIt> constexpr point max_point( FwdIt begin, FwdIt end ) noexcept {
     return *std::max_element(
         begin, end, []( const point & l, const point & r ) { return l.value < r.value; } );
@@ -0,0 +1,173 @@
+// envx's processing, shared with the benchmarks
+#pragma once
+
+#include "breakpoint/breakpoint.hpp"
+#include "util/audio_kernels.hpp"
+#include "util/buffer_arena.hpp"
+#include "util/channel_dispatch.hpp"
+#include "util/envelope_follower.hpp"
+#include "util/sndfile_utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+enum class envelope_mode { peak, rms, follow };
+
+struct envelope_settings {
+    envelope_mode mode;
+    unsigned int win_ms;
+    unsigned int hop_ms;
+    unsigned int attack_ms;  // follow only
+    unsigned int release_ms; // follow only
+    bool per_channel;
+    unsigned int threads;
+    std::optional<double> tolerance; // simplify the result to within this, if given
+};
+
+// Sum of the samples of one interleaved frame. `channels` is a size_t or a channel_count.
+template <class Channels> float frame_sum( const float * frame, const Channels channels ) noexcept {
+    float sum = 0.f;
+    for ( size_t c = 0; c < channels; ++c )
+        sum += frame[c];
+    return sum;
+}
+
+// Peak or RMS of each of the back to back windows of `samples_per_window` frames. Chunks handed to
+// the workers hold whole windows, so each window is measured in one go, in a single pass over its
+// samples. A stream of unknown length is read in order, and the envelopes grow as it goes.
+inline std::optional<std::vector<breakpoint::point_list>> measure_windows(
+    const std::string & from_path,
+    SndfileHandle & from,
+    const envelope_settings & settings,
+    const unsigned int samples_per_window ) {
+    const auto sample_rate = from.samplerate(); // samp / s
+    const size_t channels = from.channels();
+    const size_t envelopes = settings.per_channel ? channels : 1;
+    const size_t num_windows = is_seekable( from )
+        ? ( from.frames() + samples_per_window - 1 ) / samples_per_window
+        : 0;
+    std::vector<breakpoint::point_list> result( envelopes, breakpoint::point_list( num_windows ) );
+
+    auto measure = [&]( std::span<const float> block, sf_count_t first_frame ) {
+        const size_t window_samples = samples_per_window * channels;
+        auto peaks_scratch = buffer_arena::shared().borrow( envelopes );
+        auto squares_scratch = buffer_arena::shared().borrow_as<double>( envelopes );
+        const std::span<float> peaks = peaks_scratch.samples();
+        const std::span<double> squares( squares_scratch.data_as<double>(), envelopes );
+        buffer_arena::lease summed;
+        size_t window = first_frame / samples_per_window;
+        for ( size_t start = 0; start < block.size(); start += window_samples, ++window ) {
+            auto samples = block.subspan( start, std::min( window_samples, block.size() - start ) );
+            if ( window >= result[0].size() ) {
+                for ( auto & points : result )
+                    points.resize( window + 1 );
+            }
+            if ( envelopes != channels ) {
+                const size_t summed_frames = samples.size() / channels;
+                if ( !summed.data() )
+                    summed = buffer_arena::shared().borrow( window_samples / channels );
+                dispatch_channels( channels, [&]( auto c ) {
+                    for ( size_t f = 0; f < summed_frames; ++f )
+                        summed.data()[f] = frame_sum( samples.data() + f * c, c );
+                } );
+                samples = { summed.data(), summed_frames };
+            }
+
+            const size_t frames = samples.size() / envelopes;
+            auto time_secs = double( window * samples_per_window ) / sample_rate;
+            if ( settings.mode == envelope_mode::rms ) {
+                std::fill( squares.begin(), squares.end(), 0.0 );
+                audio_kernels::accumulate_squares( samples, squares );
+                for ( size_t e = 0; e < envelopes; ++e )
+                    result[e][window] = { time_secs, std::sqrt( squares[e] / frames ) };
+            } else {
+                std::fill( peaks.begin(), peaks.end(), 0.f );
+                audio_kernels::accumulate_peaks( samples, peaks );
+                for ( size_t e = 0; e < envelopes; ++e )
+                    result[e][window] = { time_secs, peaks[e] };
+            }
+        }
+    };
+
+    const size_t windows_per_chunk = std::max<size_t>( 1, 65536 / samples_per_window );
+    if ( !scan_chunks( from_path, from, measure, settings.threads,
+                       windows_per_chunk * samples_per_window ) )
+        return std::nullopt;
+    return result;
+}
+
+// Feeds every frame to a copy of `tracker` per envelope (windowed_envelope or followed_envelope),
+// in order. For overlapping windows and the follower, whose state carries over from one frame to
+// the next.
+template <class Tracker>
+std::optional<std::vector<breakpoint::point_list>> track( const std::string & from_path,
+                                                          SndfileHandle & from,
+                                                          const bool per_channel,
+                                                          const Tracker & tracker ) {
+    const size_t channels = from.channels();
+    std::vector<Tracker> trackers( per_channel ? channels : 1, tracker );
+    auto push = [&]( std::span<const float> block, sf_count_t ) {
+        dispatch_channels( channels, [&]( auto chans ) {
+            for ( size_t i = 0; i < block.size(); i += chans ) {
+                if ( per_channel ) {
+                    for ( size_t c = 0; c < chans; ++c )
+                        trackers[c].push( block[i + c] );
+                } else {
+                    trackers[0].push( frame_sum( block.data() + i, chans ) );
+                }
+            }
+        } );
+    };
+
+    // A single worker, so the chunks come in order
+    if ( !scan_chunks( from_path, from, push ) )
+        return std::nullopt;
+
+    std::vector<breakpoint::point_list> result;
+    for ( auto & t : trackers ) {
+        t.finish();
+        result.push_back( std::move( t.points() ) );
+    }
+    return result;
+}
+
+// One envelope per channel with `per_channel`, otherwise one envelope of the channels summed
+// together.
+inline std::optional<std::vector<breakpoint::point_list>> get_breakpoints(
+    const std::string & from_path,
+    SndfileHandle & from,
+    const envelope_settings & settings ) {
+    const auto sample_rate = from.samplerate(); // samp / s
+    const unsigned int samples_per_window = sample_rate * settings.win_ms / 1000u;
+    const unsigned int samples_per_hop = sample_rate * settings.hop_ms / 1000u;
+    if ( samples_per_window == 0 || samples_per_hop == 0 ) {
+        std::cout << "Window or hop is shorter than one frame" << std::endl;
+        return std::nullopt;
+    }
+
+    switch ( settings.mode ) {
+    case envelope_mode::follow:
+        return track( from_path, from, settings.per_channel,
+                      followed_envelope( settings.attack_ms / 1000.0, settings.release_ms / 1000.0,
+                                         samples_per_hop, sample_rate ) );
+    case envelope_mode::rms:
+        if ( samples_per_hop != samples_per_window )
+            return track( from_path, from, settings.per_channel,
+                          windowed_envelope<sliding_rms>( samples_per_window, samples_per_hop,
+                                                          sample_rate ) );
+        break;
+    case envelope_mode::peak:
+        if ( samples_per_hop != samples_per_window )
+            return track( from_path, from, settings.per_channel,
+                          windowed_envelope<sliding_peak>( samples_per_window, samples_per_hop,
+                                                           sample_rate ) );
+        break;
+    }
+
+    return measure_windows( from_path, from, settings, samples_per_window );
+}
@@ -1,67 +1,131 @@
-#include <cmath>
+#include <filesystem>
 #include <iostream>
 #include <optional>
 #include <string>
-#include <vector>
 
 #include "breakpoint/breakpoint.hpp"
+#include "envx/envx.hpp"
 #include "util/checked_invoke.hpp"
 #include "util/sndfile_utils.hpp"
 
-std::optional<breakpoint::point_list> get_breakpoints( SndfileHandle & from, unsigned int win_ms ) {
-    sf_count_t read = 0;
-    sf_count_t total_read = 0;
-    const auto sample_rate = from.samplerate(); // samp / s
-    const unsigned int samples_per_window = sample_rate * win_ms / 1000u;
-    std::vector<float> floats( samples_per_window );
-    breakpoint::point_list result;
+std::optional<envelope_mode> parse_mode( const std::string & name ) {
+    if ( name == "peak" )
+        return envelope_mode::peak;
+    if ( name == "rms" )
+        return envelope_mode::rms;
+    if ( name == "follow" )
+        return envelope_mode::follow;
+    return std::nullopt;
+}
 
-    while ( ( read = from.readf( floats.data(), floats.size() ) ) ) {
-        std::transform( begin( floats ), begin( floats ) + read, begin( floats ),
-                        static_cast<float ( * )( float )>( &std::fabs ) );
-        auto max = *std::max_element( begin( floats ), begin( floats ) + read );
-        auto time_secs = double( total_read ) / sample_rate;
-        result.push_back( { time_secs, max } );
-        total_read += read;
-    }
+// "env.txt" becomes "env.2.txt" for the second channel
+std::string channel_path( const std::string & path, size_t channel ) {
+    const std::filesystem::path p( path );
+    const auto number = '.' + std::to_string( channel + 1 );
+    return ( p.parent_path() / ( p.stem().string() + number + p.extension().string() ) ).string();
+}
 
-    if ( total_read != from.frames() ) {
-        std::cout << "Could not read entire file: " << from.strError() << std::endl;
-        std::cout << "Read " << total_read << " | But file has " << from.frames() << std::endl;
-        return std::nullopt;
+bool write_breakpoints( const std::string & to_path,
+                        const breakpoint::point_list & points,
+                        std::optional<breakpoint::binary_precision> binary ) {
+    // std::cout carries messages to stderr while writing to stdout; see checked_invoke
+    if ( to_path == "-" ) {
+        auto & out = stdout_output();
+        const bool ok = binary ? breakpoint::write_breakpoints_binary( out, points, *binary )
+                               : breakpoint::write_breakpoints( out, points );
+        return ok && out.flush();
     }
-
-    return result;
+    return binary ? breakpoint::write_breakpoints_binary( to_path, points, *binary )
+                  : breakpoint::write_breakpoints( to_path, points );
 }
 
 bool extract_breakpoints( const std::string & from_path,
                           const std::string & to_path,
-                          unsigned int win_ms ) {
-    auto from = require_channels( make_input_handle( from_path ), 1 );
-    auto && breakpoints = from ? get_breakpoints( *from, win_ms ) : std::nullopt;
+                          const envelope_settings & settings,
+                          std::optional<breakpoint::binary_precision> binary ) {
+    if ( settings.per_channel && to_path == "-" ) {
+        std::cout << "Can't write one file per channel to stdout" << std::endl;
+        return false;
+    }
+
+    auto from = make_input_handle( from_path );
+    auto && breakpoints = from ? get_breakpoints( from_path, *from, settings ) : std::nullopt;
     if ( !breakpoints ) {
         std::cout << "Error reading input file: " << from_path << std::endl;
         return false;
     }
 
-    if ( breakpoint::write_breakpoints( to_path, *breakpoints ) ) {
-        return true;
-    } else {
-        std::cout << "Error writing breakpoints: " << to_path << std::endl;
-        return false;
+    for ( size_t i = 0; i < breakpoints->size(); ++i ) {
+        if ( settings.tolerance )
+            ( *breakpoints )[i] = breakpoint::simplify( ( *breakpoints )[i], *settings.tolerance );
+
+        const auto path = settings.per_channel ? channel_path( to_path, i ) : to_path;
+        if ( !write_breakpoints( path, ( *breakpoints )[i], binary ) ) {
+            std::cout << "Error writing breakpoints: " << path << std::endl;
+            return false;
+        }
     }
+    return true;
 }
 
 int main( int argc, char ** argv ) {
-    unsigned int win_ms;
-    simple_options::options opts{ "envx", "Extract a breakpoint file from a mono input file" };
+    envelope_settings settings;
+    std::string mode;
+    double tolerance;
+    simple_options::options opts{ "envx", "Extract a breakpoint file from an input file" };
     opts.basic_option( "help,h", "Print description and exit" )
-        .positional( "input", "Input file" )
-        .positional( "output", "Output file" )
+        .positional( "input", "Input file, or - for stdin" )
+        .positional( "output", "Output file, or - for stdout" )
+        .basic_option( "mode,m",
+                       "What to follow: peak or rms of each window, or follow for an "
+                       "attack/release envelope follower",
+                       simple_options::defaulted_value( &mode, std::string( "peak" ) ) )
         .basic_option( "winsize-millis,w", "Window size in milliseconds",
-                       simple_options::defaulted_value( &win_ms, 15 ) )
+                       simple_options::defaulted_value( &settings.win_ms, 15 ) )
+        .stored_option( "hop-millis", "Time between points in milliseconds (default: window size)",
+                        &settings.hop_ms )
+        .basic_option( "attack-millis", "Attack time of the follower in milliseconds",
+                       simple_options::defaulted_value( &settings.attack_ms, 0 ) )
+        .basic_option( "release-millis", "Release time of the follower in milliseconds",
+                       simple_options::defaulted_value( &settings.release_ms, 100 ) )
+        .basic_option( "per-channel,c",
+                       "Write one file per channel, numbered before the output's extension, "
+                       "instead of one for the channels summed" )
+        .basic_option( "threads,j",
+                       "Number of threads to read chunks of the file on, for peak and rms "
+                       "without overlapping windows",
+                       simple_options::defaulted_value( &settings.threads, 1u ) )
+        .stored_option( "tolerance,t",
+                        "Drop points that straight lines between the others pass within this of",
+                        &tolerance )
+        .basic_option( "binary", "Write the binary breakpoint format, with double precision" )
+        .basic_option( "binary32", "Write the binary breakpoint format, with single precision" )
         .parse( argc, argv );
 
+    auto parsed_mode = parse_mode( mode );
+    if ( !parsed_mode ) {
+        std::cout << "Unknown mode: " << mode << std::endl;
+        return 1;
+    }
+    settings.mode = *parsed_mode;
+    settings.per_channel = opts.has( "per-channel" );
+    if ( !opts.has( "hop-millis" ) )
+        settings.hop_ms = settings.win_ms;
+    if ( opts.has( "tolerance" ) ) {
+        if ( !( tolerance >= 0 ) ) {
+            std::cout << "Tolerance must be zero or more: " << tolerance << std::endl;
+            return 1;
+        }
+        settings.tolerance = tolerance;
+    }
+
+    std::optional<breakpoint::binary_precision> binary;
+    if ( opts.has( "binary32" ) )
+        binary = breakpoint::binary_precision::float32;
+    else if ( opts.has( "binary" ) )
+        binary = breakpoint::binary_precision::float64;
+
     using namespace std::placeholders;
-    return checked_invoke_in_out( opts, std::bind( extract_breakpoints, _1, _2, win_ms ) );
+    return checked_invoke_in_out( opts,
+                                  std::bind( extract_breakpoints, _1, _2, settings, binary ) );
 }
@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 
+#include "util/buffer_arena.hpp"
 #include "util/checked_invoke.hpp"
 #include "util/sndfile_utils.hpp"
 
@@ -14,7 +15,7 @@ bool do_copy_impl( SndfileHandle & from,
                    SndfileHandle & to2,
                    const size_t bufsize,
                    const size_t randblock ) {
-    std::vector<float> floats( from.channels() * bufsize );
+    auto floats = buffer_arena::shared().borrow( from.channels() * bufsize );
     auto choose_new_outfile = [&to1, &to2]() -> SndfileHandle { return rand() & 0x1 ? to1 : to2; };
 
     sf_count_t read = 0;
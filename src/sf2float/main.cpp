@@ -1,49 +1,174 @@
+#include <algorithm>
 #include <iostream>
+#include <optional>
 #include <string>
+#include <type_traits>
 #include <vector>
 
+#include "util/buffer_arena.hpp"
 #include "util/checked_invoke.hpp"
+#include "util/sample_dispatch.hpp"
 #include "util/simple_options.hpp"
 #include "util/sndfile_utils.hpp"
 
-bool do_copy_repeated( SndfileHandle & from,
-                       SndfileHandle & to,
-                       const size_t bufsize,
-                       const size_t repeats ) {
-    for ( auto i = 0ul; i < repeats; ++i ) {
-        auto result = transform_copy(
-            from, to, []( auto ) {}, bufsize );
-        if ( !result ) {
+// Frames per block when --bufsize isn't given: about 256 KiB of samples of the type the copy runs
+// in, so that libsndfile's per-call overhead is negligible while a block still fits in cache
+size_t auto_bufsize( const int channels, const size_t sample_size ) {
+    const size_t frames = ( 256 * 1024 ) / ( channels * sample_size );
+    return std::clamp<size_t>( frames / 1024 * 1024, 1024, 65536 );
+}
+
+// Copies `from` to `to` `repeats` times through one buffer, in the input's own sample type when
+// the output can hold it (e.g. 16-bit to 16-bit as shorts). If `from_path` is an uncompressed file
+// copied as floats, blocks are written straight out of a memory mapping of it, mapped once for all
+// the repeats.
+template <class Sample>
+bool copy_repeated( const std::string & from_path,
+                    SndfileHandle & from,
+                    SndfileHandle & to,
+                    const size_t bufsize,
+                    const size_t repeats ) {
+    const int channels = from.channels();
+    auto buffer = buffer_arena::shared().borrow_as<Sample>( bufsize * channels );
+    Sample * samples = buffer.template data_as<Sample>();
+
+    std::optional<mapped_pcm_reader> reader;
+    if constexpr ( std::is_same_v<Sample, float> )
+        reader = mapped_pcm_reader::open( from_path, from );
+
+    auto write = [&to]( const Sample * block, const sf_count_t frames ) {
+        auto written = to.writef( block, frames );
+        if ( written < frames ) {
+            std::cout << "Error while writing (" << written << " written): " << to.strError()
+                      << std::endl;
+            return false;
+        }
+        return true;
+    };
+
+    for ( size_t i = 0; i < repeats; ++i ) {
+        if constexpr ( std::is_same_v<Sample, float> ) {
+            if ( reader ) {
+                for ( sf_count_t frame = 0; frame < reader->frames(); ) {
+                    auto in = reader->read( frame, bufsize, { samples, bufsize * channels } );
+                    const sf_count_t frames = in.size() / channels;
+                    if ( !write( in.data(), frames ) )
+                        return false;
+                    frame += frames;
+                }
+                continue;
+            }
+        }
+
+        if ( i > 0 && from.seek( 0, SEEK_SET ) != 0 ) {
+            std::cout << "Could not seek file: " << from_path << std::endl;
             return false;
         }
 
-        from.seek( 0, 0 );
+        sf_count_t read = 0;
+        sf_count_t total_read = 0;
+        while ( ( read = from.readf( samples, bufsize ) ) ) {
+            if ( !write( samples, read ) )
+                return false;
+            total_read += read;
+        }
+        if ( !check_read_all( from, total_read ) )
+            return false;
     }
 
     return true;
 }
 
+// As copy_repeated, but reading and writing on threads of their own
+template <class Sample>
+bool copy_repeated_pipelined( const std::string & from_path,
+                              SndfileHandle & from,
+                              SndfileHandle & to,
+                              const size_t bufsize,
+                              const size_t repeats ) {
+    for ( size_t i = 0; i < repeats; ++i ) {
+        if ( i > 0 && from.seek( 0, SEEK_SET ) != 0 ) {
+            std::cout << "Could not seek file: " << from_path << std::endl;
+            return false;
+        }
+        if ( !transform_copy_pipelined<Sample>( from, to, []( auto ) {}, bufsize ) )
+            return false;
+    }
+
+    return true;
+}
+
+// The WAV subtype called `name`
+std::optional<int> parse_subtype( const std::string & name ) {
+    if ( name == "float" )
+        return SF_FORMAT_FLOAT;
+    if ( name == "double" )
+        return SF_FORMAT_DOUBLE;
+    if ( name == "pcm16" )
+        return SF_FORMAT_PCM_16;
+    if ( name == "pcm24" )
+        return SF_FORMAT_PCM_24;
+    if ( name == "pcm32" )
+        return SF_FORMAT_PCM_32;
+    return std::nullopt;
+}
+
+// `bufsize` 0 picks one to suit the copy
 bool do_copy( const std::string & from_path,
               const std::string & to_path,
               const size_t bufsize,
-              const size_t repeats ) {
+              const size_t repeats,
+              const bool pipeline,
+              const int subtype ) {
+    if ( repeats > 1 && is_stdio_path( from_path ) ) {
+        std::cout << "Can't repeat a copy from stdin" << std::endl;
+        return false;
+    }
+
     auto from = make_input_handle( from_path );
-    auto to = make_output_handle( to_path, from, SF_FORMAT_WAV | SF_FORMAT_FLOAT );
-    return from && to ? do_copy_repeated( *from, *to, bufsize, repeats ) : false;
+    auto to = make_output_handle( to_path, from, SF_FORMAT_WAV | subtype );
+    if ( !from || !to ) {
+        return false;
+    }
+
+    return dispatch_sample_format( from->format(), to->format(), [&]( auto type ) {
+        using Sample = typename decltype( type )::type;
+        const size_t frames =
+            bufsize ? bufsize : auto_bufsize( from->channels(), sizeof( Sample ) );
+        return report_throughput<Sample>(
+            *from,
+            [&] {
+                return pipeline
+                    ? copy_repeated_pipelined<Sample>( from_path, *from, *to, frames, repeats )
+                    : copy_repeated<Sample>( from_path, *from, *to, frames, repeats );
+            },
+            repeats );
+    } );
 }
 
 int main( int argc, char ** argv ) {
     simple_options::options opts{ "sf2float" };
-    size_t bufsize, repeats;
+    size_t bufsize = 0, repeats;
+    std::string type;
     opts.basic_option( "help,h", "Print description and exit" )
-        .basic_option( "bufsize,b", "Buffer size in frames",
-                       simple_options::defaulted_value( &bufsize, 1 ) )
+        .stored_option( "bufsize,b",
+                        "Buffer size in frames (default: about 256 KiB of samples)", &bufsize )
         .basic_option( "repeats,r", "Number of times to repeat",
                        simple_options::defaulted_value( &repeats, 1 ) )
-        .positional( "input", "Input file" )
-        .positional( "output", "Output file" )
+        .basic_option( "pipeline", "Overlap reading and writing" )
+        .basic_option( "type,t", "Sample type to write: float, double, pcm16, pcm24 or pcm32",
+                       simple_options::defaulted_value( &type, std::string( "float" ) ) )
+        .positional( "input", "Input file, or - for stdin" )
+        .positional( "output", "Output file, or - for stdout" )
         .parse( argc, argv );
 
+    auto subtype = parse_subtype( type );
+    if ( !subtype ) {
+        std::cout << "Unknown sample type: " << type << std::endl;
+        return 1;
+    }
+
     using namespace std::placeholders;
-    return checked_invoke_in_out( opts, std::bind( do_copy, _1, _2, bufsize, repeats ) );
+    return checked_invoke_in_out( opts, std::bind( do_copy, _1, _2, bufsize, repeats,
+                                                   opts.has( "pipeline" ), *subtype ) );
 }
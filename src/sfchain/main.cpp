@@ -0,0 +1,149 @@
+// normalize, scale, envelope and pan a file in a single pass
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "breakpoint/breakpoint.hpp"
+#include "util/audio_kernels.hpp"
+#include "util/basic_envelope_generator.hpp"
+#include "util/checked_invoke.hpp"
+#include "util/pan_utils.hpp"
+#include "util/sndfile_utils.hpp"
+#include "util/stereo_envelope_generator.hpp"
+
+// What to do to each file. The stages run in the order sfnorm, sfgain, sfenv and sfpan would be
+// run one after the other, but on each block in turn, so the audio is only read and written once.
+struct chain_settings {
+    std::optional<double> level_db; // normalize the input's peak to this level first
+    Amplitude gain = 1.f;
+    std::span<const breakpoint::point> envelope; // if empty, no envelope
+    std::span<const breakpoint::point> pan;      // if empty, no panning (mono in, stereo out)
+    bool pipeline = false;
+    peak_cache * cache = nullptr; // for finding the peak to normalize, if not null
+};
+
+static bool run_chain( const std::string & from_path,
+                       const std::string & to_path,
+                       const chain_settings & settings,
+                       const size_t bufsize = 1024 ) {
+    const bool panned = !settings.pan.empty();
+    auto from = make_input_handle( from_path );
+    if ( panned ) {
+        from = require_channels( std::move( from ), 1 );
+    }
+    if ( !from ) {
+        return false;
+    }
+
+    // Normalizing and gain are both a constant factor, applied together
+    Amplitude scale = settings.gain;
+    if ( settings.level_db ) {
+        auto peak = find_peak( from_path, *from, 1, settings.cache );
+        if ( !peak ) {
+            return false;
+        }
+        if ( from->seek( 0, SEEK_SET ) == -1 ) {
+            std::cout << "Could not seek file: " << from_path << std::endl;
+            return false;
+        }
+        scale *= Amplitude( db_to_amp( *settings.level_db ) / *peak );
+    }
+
+    auto to = make_output_handle( to_path, from, SF_INPUT_FORMAT,
+                                  panned ? 2 : SF_INPUT_CHANNELS );
+    if ( !to ) {
+        return false;
+    }
+
+    const int channels = from->channels();
+    std::optional<basic_envelope_generator> envelope;
+    if ( !settings.envelope.empty() )
+        envelope.emplace( settings.envelope, from->samplerate(), bufsize );
+    std::optional<stereo_envelope_generator> pan;
+    if ( panned )
+        pan.emplace( settings.pan, from->samplerate(), bufsize );
+
+    auto apply = [&]( std::span<float> data ) {
+        const size_t frames = data.size() / channels;
+        if ( scale != 1.f )
+            scale_by( scale )( data );
+        if ( envelope )
+            audio_kernels::apply_gain_envelope( data, envelope->next_frames( frames ), channels );
+        if ( pan )
+            pan_mono_in_place( { data.data(), frames * 2 }, pan->next_frames( frames ), frames );
+    };
+
+    if ( settings.pipeline ) {
+        return report_throughput(
+            *from, [&] { return transform_copy_pipelined( *from, *to, apply, bufsize ); } );
+    }
+    return transform_copy( *from, *to, apply, bufsize );
+}
+
+static std::optional<breakpoint::breakpoint_file> load_breakpoints( const std::string & path ) {
+    auto breakpoints = breakpoint::read_breakpoints( path );
+    if ( auto * perr = std::get_if<breakpoint::parse_error>( &breakpoints ) ) {
+        std::cout << "Error parsing breakpoint file '" << path << "': " << *perr << std::endl;
+        return std::nullopt;
+    }
+    return std::move( std::get<breakpoint::breakpoint_file>( breakpoints ) );
+}
+
+int main( int argc, char ** argv ) {
+    simple_options::options opts{ "sfchain",
+                                  "Normalize, scale, apply an envelope to and pan a file in one "
+                                  "pass" };
+    double level;
+    Amplitude gain;
+    std::string envelope_path, pan_path;
+    batch_settings batch;
+    opts.basic_option( "help,h", "Print description and exit" )
+        .basic_option( "level,l", "Normalize the input's peak to this level in dB first",
+                       simple_options::value( &level ) )
+        .basic_option( "scale,a", "Amplitude scaling",
+                       simple_options::defaulted_value( &gain, 1.0 ) )
+        .stored_option( "envelope,e", "Breakpoint file to apply as an envelope", &envelope_path )
+        .stored_option( "pan,p", "Breakpoint file to pan a mono input into stereo with",
+                        &pan_path )
+        .basic_option( "pipeline", "Overlap reading, processing and writing; report throughput" )
+        .basic_option( "no-cache",
+                       "With --level, don't use or update the peak cache next to the input file" )
+        .positional( "input", "Input file, or - for stdin" )
+        .positional( "output", "Output file, or - for stdout" );
+    add_batch_options( opts, batch );
+    opts.parse( argc, argv );
+
+    peak_cache cache;
+    chain_settings settings;
+    settings.gain = gain;
+    settings.pipeline = opts.has( "pipeline" );
+    settings.cache = opts.has( "no-cache" ) ? nullptr : &cache;
+    if ( opts.has( "level" ) )
+        settings.level_db = level;
+
+    // Loaded once and shared by every job of a batch
+    std::optional<breakpoint::breakpoint_file> envelope, pan;
+    if ( !envelope_path.empty() ) {
+        if ( !( envelope = load_breakpoints( envelope_path ) ) )
+            return 2;
+        settings.envelope = envelope->points();
+    }
+    if ( !pan_path.empty() ) {
+        if ( !( pan = load_breakpoints( pan_path ) ) )
+            return 2;
+        settings.pan = pan->points();
+        if ( !std::all_of( settings.pan.begin(), settings.pan.end(),
+                           []( auto x ) { return x.value >= -1.0 && x.value <= 1.0; } ) ) {
+            std::cout << "Breakpoints are outside the -1 to +1 range" << std::endl;
+            return 2;
+        }
+    }
+
+    using namespace std::placeholders;
+    return checked_invoke_batch( opts, std::array{ "input", "output" }, batch,
+                                 std::bind( run_chain, _1, _2, settings, 1024 ) );
+}
@@ -2,55 +2,60 @@
 #include <vector>
 
 #include "breakpoint/breakpoint.hpp"
-#include "util/basic_envelope_generator.hpp"
+#include "sfenv/sfenv.hpp"
 #include "util/checked_invoke.hpp"
-#include "util/pan_utils.hpp"
 #include "util/sndfile_utils.hpp"
 
-static void multichan_multiply( std::span<float> & out,
-                                const std::span<float> & in,
-                                int num_channels ) {
-    sf_count_t i = 0;
-    for ( auto amp : in )
-        for ( int chan = 0; chan < num_channels; i++, chan++ )
-            out[i] *= amp;
-}
-
-static bool apply_breakpoints_impl( SndfileHandle & from,
-                                    SndfileHandle & to,
-                                    const breakpoint::point_list & points,
-                                    const size_t bufsize = 1024 ) {
-    basic_envelope_generator gen( points, from.samplerate(), bufsize );
-    return transform_copy( from, to, [&gen, &from]( auto span ) {
-        multichan_multiply( span, gen.next_frames( span.size() ), from.channels() );
-    } );
-}
-
-static void normalize( breakpoint::point_list & points ) {
+static breakpoint::point_list normalize( std::span<const breakpoint::point> points ) {
     auto max = max_point( points.begin(), points.end() );
-    for ( auto x : points )
+    breakpoint::point_list result( points.begin(), points.end() );
+    for ( auto & x : result )
         x.value /= max.value;
+    return result;
 }
 
 static bool apply_breakpoints( const std::string & from_path,
                                const std::string & to_path,
                                const std::string & breakpoints_path,
-                               bool do_normalize ) {
+                               bool do_normalize,
+                               bool pipeline,
+                               bool stream,
+                               unsigned threads ) {
     auto from = make_input_handle( from_path );
     auto to = make_output_handle( to_path, from );
     if ( !from || !to ) {
         return false;
     }
 
-    auto breakpoints = breakpoint::parse_breakpoints( breakpoints_path );
+    if ( stream ) {
+        if ( do_normalize ) {
+            std::cout << "Can't normalize a streamed envelope" << std::endl;
+            return false;
+        }
+
+        // Catches files that can't be opened before any rendering is done
+        if ( !report_envelope_error( breakpoint::point_stream( breakpoints_path ).error(),
+                                     breakpoints_path ) )
+            return false;
+
+        const envelope_source source{ {}, breakpoints_path };
+        if ( threads > 1 )
+            return apply_breakpoints_parallel( from_path, *from, *to, source, threads );
+        return apply_breakpoints_impl( *from, *to, source, pipeline );
+    }
+
+    auto breakpoints = breakpoint::read_breakpoints( breakpoints_path );
     if ( auto * perr = std::get_if<breakpoint::parse_error>( &breakpoints ) ) {
         std::cout << "Error parsing breakpoint file '" << breakpoints_path << "': " << *perr
                   << std::endl;
         return false;
-    } else if ( auto * pvals = std::get_if<breakpoint::point_list>( &breakpoints ) ) {
+    } else if ( auto * pfile = std::get_if<breakpoint::breakpoint_file>( &breakpoints ) ) {
         if ( do_normalize )
-            normalize( *pvals );
-        return apply_breakpoints_impl( *from, *to, *pvals );
+            *pfile = breakpoint::breakpoint_file( normalize( pfile->points() ) );
+        const envelope_source source{ pfile->points(), {} };
+        if ( threads > 1 )
+            return apply_breakpoints_parallel( from_path, *from, *to, source, threads );
+        return apply_breakpoints_impl( *from, *to, source, pipeline );
     } else {
         std::cout << "Unknown error while parsing breakpoints" << std::endl;
         return false;
@@ -60,14 +65,30 @@ static bool apply_breakpoints( const std::string & from_path,
 int main( int argc, char ** argv ) {
     simple_options::options opts{ "sfenv",
                                   "Apply a breakpoint file as an envelope on an input file" };
+    unsigned threads;
+    batch_settings batch;
     opts.basic_option( "help,h", "Print description and exit" )
         .basic_option( "normalize,n", "Normalize breakpoints first" )
-        .positional( "input", "Input file" )
-        .positional( "output", "Output file" )
-        .positional( "breakpoints", "Breakpoint file" )
-        .parse( argc, argv );
+        .basic_option( "pipeline",
+                       "Overlap reading, processing and writing; report throughput. Can't be "
+                       "combined with --threads" )
+        .basic_option( "stream", "Read the breakpoint file while rendering instead of up front" )
+        .basic_option( "threads,j", "Number of threads to process chunks of the file on",
+                       simple_options::defaulted_value( &threads, 1u ) )
+        .positional( "input", "Input file, or - for stdin" )
+        .positional( "output", "Output file, or - for stdout" )
+        .positional( "breakpoints", "Breakpoint file" );
+    add_batch_options( opts, batch );
+    opts.parse( argc, argv );
+
+    if ( opts.has( "pipeline" ) && threads > 1 && !opts.has( "help" ) ) {
+        std::cout << "--pipeline can't be combined with --threads" << std::endl;
+        return 1;
+    }
 
     using namespace std::placeholders;
-    return checked_invoke_in_out_bkpts(
-        opts, std::bind( apply_breakpoints, _1, _2, _3, opts.has( "normalize" ) ) );
+    return checked_invoke_batch(
+        opts, std::array{ "input", "output", "breakpoints" }, batch,
+        std::bind( apply_breakpoints, _1, _2, _3, opts.has( "normalize" ), opts.has( "pipeline" ),
+                   opts.has( "stream" ), threads ) );
 }
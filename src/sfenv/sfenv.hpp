@@ -0,0 +1,107 @@
+// sfenv's processing, shared with the benchmarks
+#pragma once
+
+#include "breakpoint/breakpoint.hpp"
+#include "util/audio_kernels.hpp"
+#include "util/basic_envelope_generator.hpp"
+#include "util/channel_dispatch.hpp"
+#include "util/sample_dispatch.hpp"
+#include "util/sndfile_utils.hpp"
+
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+
+// `channels` is an int or a channel_count; with the latter the kernel is picked at compile time.
+// `out` holds short, int, float or double samples.
+template <class Sample, class Channels>
+void multichan_multiply( std::span<Sample> out,
+                         std::span<const float> in,
+                         const Channels channels ) {
+    audio_kernels::apply_gain_envelope( out, in, channels );
+}
+
+// Where the envelope comes from: points loaded up front, or a breakpoint file streamed while
+// rendering so that an envelope of any length fits in constant memory.
+struct envelope_source {
+    std::span<const breakpoint::point> points;
+    std::string stream_path; // if not empty, used instead of `points`
+
+    std::unique_ptr<basic_envelope_generator> make_generator( const uint32_t sample_rate,
+                                                              const size_t bufsize ) const {
+        if ( stream_path.empty() )
+            return std::make_unique<basic_envelope_generator>( points, sample_rate, bufsize );
+        return std::make_unique<basic_envelope_generator>(
+            breakpoint::point_stream( stream_path ), sample_rate, bufsize );
+    }
+};
+
+// A streamed envelope is only checked as it is read, so it can turn out to be bad partway through
+inline bool report_envelope_error( const breakpoint::parse_error & error,
+                                   const std::string & path ) {
+    if ( error.code == breakpoint::parse_error::success )
+        return true;
+    std::cout << "Error parsing breakpoint file '" << path << "': " << error << std::endl;
+    return false;
+}
+
+inline bool apply_breakpoints_impl( SndfileHandle & from,
+                                    SndfileHandle & to,
+                                    const envelope_source & source,
+                                    const bool pipeline,
+                                    const size_t bufsize = 1024 ) {
+    auto gen = source.make_generator( from.samplerate(), bufsize );
+    // The copy is instantiated for each common channel count and each sample type, so integer
+    // files are enveloped without converting them to float
+    const bool ok = dispatch_channels( from.channels(), [&]( auto channels ) {
+        auto apply = [&gen, channels]( auto span ) {
+            multichan_multiply( span, gen->next_frames( span.size() / channels ), channels );
+        };
+
+        return dispatch_sample_format( from.format(), to.format(), [&]( auto type ) {
+            using Sample = typename decltype( type )::type;
+            if ( pipeline ) {
+                return report_throughput<Sample>( from, [&] {
+                    return transform_copy_pipelined<Sample>( from, to, apply, bufsize );
+                } );
+            }
+            return transform_copy<Sample>( from, to, apply, bufsize );
+        } );
+    } );
+
+    return ok && report_envelope_error( gen->error(), source.stream_path );
+}
+
+// Each worker renders the envelope for its own chunks, starting wherever the chunk starts
+inline bool apply_breakpoints_parallel( const std::string & from_path,
+                                        SndfileHandle & from,
+                                        SndfileHandle & to,
+                                        const envelope_source & source,
+                                        const unsigned threads,
+                                        const size_t chunk_frames = 65536 ) {
+    std::mutex error_mutex;
+    breakpoint::parse_error error{ breakpoint::parse_error::success, 0 };
+    const bool ok = dispatch_channels( from.channels(), [&]( auto channels ) {
+        auto make_transform = [&, channels, chunk_frames] {
+            auto gen = source.make_generator( from.samplerate(), chunk_frames );
+            return [&, gen = std::move( gen ), channels]( auto span, sf_count_t first_frame ) {
+                multichan_multiply( span, gen->frames_at( first_frame, span.size() / channels ),
+                                    channels );
+                if ( gen->error().code != breakpoint::parse_error::success ) {
+                    std::lock_guard lock( error_mutex );
+                    if ( error.code == breakpoint::parse_error::success )
+                        error = gen->error();
+                }
+            };
+        };
+        return dispatch_sample_format( from.format(), to.format(), [&]( auto type ) {
+            using Sample = typename decltype( type )::type;
+            return transform_copy_parallel<Sample>( from_path, from, to, make_transform, threads,
+                                                    chunk_frames );
+        } );
+    } );
+
+    return ok && report_envelope_error( error, source.stream_path );
+}
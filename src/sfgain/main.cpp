@@ -1,3 +1,4 @@
+#include "sfgain/sfgain.hpp"
 #include "util/checked_invoke.hpp"
 #include "util/sndfile_utils.hpp"
 
@@ -5,23 +6,45 @@
 
 static bool fwd_scale_copy( const std::string & from_path,
                             const std::string & to_path,
-                            const Amplitude amp_scale ) noexcept {
+                            const Amplitude amp_scale,
+                            const bool pipeline,
+                            const unsigned threads ) noexcept {
     auto from = make_input_handle( from_path );
     auto to = make_output_handle( to_path, from );
-    return from && to ? scale_copy( *from, *to, amp_scale ) : false;
+    if ( !from || !to ) {
+        return false;
+    }
+
+    return gain_copy( from_path, *from, *to, amp_scale, pipeline, threads );
 }
 
 int main( int argc, char ** argv ) {
     Amplitude amp_scale;
+    unsigned threads;
+    batch_settings batch;
 
     simple_options::options opts{ "sfgain", "Scale an audio file's amplitude" };
     opts.basic_option( "help,h", "Print description and exit" )
         .basic_option( "scale,a", "Amplitude scaling",
                        simple_options::defaulted_value( &amp_scale, 1.0 ) )
-        .positional( "input", "Input file" )
-        .positional( "output", "Output file" )
-        .parse( argc, argv );
+        .basic_option( "pipeline",
+                       "Overlap reading, processing and writing; report throughput. Can't be "
+                       "combined with --threads" )
+        .basic_option( "threads,j", "Number of threads to process chunks of the file on",
+                       simple_options::defaulted_value( &threads, 1u ) )
+        .positional( "input", "Input file, or - for stdin" )
+        .positional( "output", "Output file, or - for stdout" );
+    add_batch_options( opts, batch );
+    opts.parse( argc, argv );
+
+    // Chunks processed on several threads are already read and written on separate threads
+    if ( opts.has( "pipeline" ) && threads > 1 && !opts.has( "help" ) ) {
+        std::cout << "--pipeline can't be combined with --threads" << std::endl;
+        return 1;
+    }
 
     using namespace std::placeholders;
-    return checked_invoke_in_out( opts, std::bind( fwd_scale_copy, _1, _2, amp_scale ) );
+    return checked_invoke_batch( opts, std::array{ "input", "output" }, batch,
+                                 std::bind( fwd_scale_copy, _1, _2, amp_scale,
+                                            opts.has( "pipeline" ), threads ) );
 }
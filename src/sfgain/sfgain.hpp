@@ -0,0 +1,38 @@
+// sfgain's processing, shared with the benchmarks
+#pragma once
+
+#include "util/sample_dispatch.hpp"
+#include "util/sndfile_utils.hpp"
+
+#include <string>
+
+// Scales `from` into `to`. `from_path` is where `from` was opened, so that its samples can be
+// mapped or read by several threads; "-" (see is_stdio_path) reads only through the handle.
+inline bool gain_copy( const std::string & from_path,
+                       SndfileHandle & from,
+                       SndfileHandle & to,
+                       const Amplitude amp_scale,
+                       const bool pipeline,
+                       const unsigned threads ) noexcept {
+    if ( threads > 1 ) {
+        auto make_transform = [amp_scale] {
+            return [scale = scale_by( amp_scale )]( auto data, sf_count_t ) { scale( data ); };
+        };
+        return dispatch_sample_format( from.format(), to.format(), [&]( auto type ) {
+            using Sample = typename decltype( type )::type;
+            return transform_copy_parallel<Sample>( from_path, from, to, make_transform,
+                                                    threads );
+        } );
+    }
+
+    if ( pipeline ) {
+        return dispatch_sample_format( from.format(), to.format(), [&]( auto type ) {
+            using Sample = typename decltype( type )::type;
+            return report_throughput<Sample>( from, [&] {
+                return transform_copy_pipelined<Sample>( from, to, scale_by( amp_scale ) );
+            } );
+        } );
+    }
+
+    return scale_copy( from_path, from, to, amp_scale );
+}
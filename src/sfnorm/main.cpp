@@ -1,48 +1,89 @@
+#include <algorithm>
 #include <iostream>
+#include <optional>
+#include <span>
 #include <string>
 #include <vector>
 
 #include "util/checked_invoke.hpp"
 #include "util/sndfile_utils.hpp"
 
-bool get_peak_impl( SndfileHandle & handle, double & peak ) {
-    if ( handle.command( SFC_GET_SIGNAL_MAX, &peak, sizeof( peak ) ) ) {
+// How to find peaks that the file doesn't record itself
+struct peak_source {
+    unsigned threads;
+    peak_cache * cache; // null to always scan
+};
+
+static bool print_peak( const std::string & input, const peak_source & source ) noexcept {
+    auto handle = make_input_handle( input );
+    std::optional<double> peak;
+    if ( handle && ( peak = find_peak( input, *handle, source.threads, source.cache ) ) ) {
+        std::cout << amp_to_db( *peak ) << std::endl;
         return true;
+    } else {
+        return false;
     }
+}
 
-    int result = handle.command( SFC_CALC_NORM_SIGNAL_MAX, &peak, sizeof( peak ) );
-    if ( result != 0 ) {
-        std::cout << "Could not calc peak (return code=" << result << ")" << std::endl;
+static bool print_channel_peaks( const std::string & input,
+                                 const peak_source & source ) noexcept {
+    auto handle = make_input_handle( input );
+    if ( !handle ) {
         return false;
-    } else {
-        return true;
     }
-}
 
-static bool print_peak( const std::string & input ) noexcept {
-    double peak;
+    auto peaks = scan_channel_peaks( input, *handle, source.threads, source.cache );
+    if ( !peaks ) {
+        return false;
+    }
 
-    auto handle = make_input_handle( input );
-    if ( handle && get_peak_impl( *handle, peak ) ) {
+    for ( auto peak : *peaks ) {
         std::cout << amp_to_db( peak ) << std::endl;
-        return true;
-    } else {
-        return false;
     }
+    return true;
+}
+
+// Scales `in` into `out`. With a `meter`, also measures what gets written on the way.
+static bool scale_and_measure( const std::string & input,
+                               SndfileHandle & in,
+                               SndfileHandle & out,
+                               const Amplitude scale,
+                               const bool pipeline,
+                               signal_meter * meter ) noexcept {
+    if ( pipeline ) {
+        return report_throughput( in, [&] {
+            return transform_copy_pipelined( in, out, [&]( std::span<float> data ) {
+                scale_by( scale )( data );
+                if ( meter )
+                    meter->add( data );
+            } );
+        } );
+    }
+
+    return transform_copy_mapped(
+        input, in, out, [&]( std::span<const float> from, std::span<float> to ) {
+            std::transform( from.begin(), from.end(), to.begin(),
+                            [scale]( auto x ) { return x * scale; } );
+            if ( meter )
+                meter->add( to );
+        } );
 }
 
 static bool normalize( const std::string & input,
                        const std::string & output,
-                       double level_amp ) noexcept {
+                       double level_amp,
+                       bool pipeline,
+                       const peak_source & source ) noexcept {
     auto in_handle = make_input_handle( input );
     if ( !in_handle ) {
         return false;
     }
 
-    double peak;
-    if ( !get_peak_impl( *in_handle, peak ) ) {
+    const auto found = find_peak( input, *in_handle, source.threads, source.cache );
+    if ( !found ) {
         return false;
     }
+    const double peak = *found;
 
     const auto scale = level_amp / peak;
 
@@ -57,24 +98,77 @@ static bool normalize( const std::string & input,
     }
 
     auto out_handle = make_output_handle( output, in_handle );
-    return out_handle ? scale_copy( *in_handle, *out_handle, scale ) : false;
+    if ( !out_handle ) {
+        return false;
+    }
+
+    // Lets the next tool read the new peak from the file instead of scanning it
+    const bool has_peak_chunk = add_peak_chunk( *out_handle );
+    const bool float_output = ( out_handle->format() & SF_FORMAT_SUBMASK ) == SF_FORMAT_FLOAT;
+
+    // Float files without a PEAK chunk (e.g. RAW or CAF) get a cache entry instead, so only they
+    // are measured. For integer formats, what was measured is not exactly what will be read back,
+    // so they get neither.
+    std::optional<signal_meter> meter;
+    if ( source.cache && float_output && !has_peak_chunk ) {
+        meter.emplace( in_handle->channels() );
+    }
+
+    if ( !scale_and_measure( input, *in_handle, *out_handle, scale, pipeline,
+                             meter ? &*meter : nullptr ) ) {
+        return false;
+    }
+
+    // The entry has to be made after closing, once the size and modification time are final.
+    out_handle.reset();
+    if ( meter ) {
+        source.cache->store( output, meter->stats() );
+    }
+    return true;
 }
 
 int main( int argc, char ** argv ) {
     simple_options::options opts{ "sfnorm", "Use peak information in a file to normalize it." };
     double level;
+    unsigned threads;
+    batch_settings batch;
     opts.basic_option( "help,h", "Print description and exit" )
         .basic_option( "peak-only,p", "Print the peak in dB and exit" )
+        .basic_option( "per-channel,c", "With --peak-only, print the peak of each channel" )
         .basic_option( "level,l", "Normalization level in dB",
                        simple_options::defaulted_value( &level, 0.0 ) )
+        .basic_option( "pipeline", "Overlap reading, processing and writing; report throughput" )
+        .basic_option( "threads,j", "Number of threads to scan for the peak with",
+                       simple_options::defaulted_value( &threads, 1u ) )
+        .basic_option( "no-cache", "Don't use or update the peak cache next to the input file" )
+        .basic_option( "cache-stats", "Print peak cache hits and misses when done" )
         .positional( "input", "Input file" )
-        .positional( "output", "Output file" )
-        .parse( argc, argv );
+        .positional( "output", "Output file" );
+    add_batch_options( opts, batch );
+    opts.parse( argc, argv );
+
+    if ( opts.has( "cache-stats" ) && opts.has( "no-cache" ) && !opts.has( "help" ) ) {
+        std::cout << "--cache-stats can't be used with --no-cache" << std::endl;
+        return 1;
+    }
+
+    peak_cache cache;
+    const peak_source source{ threads, opts.has( "no-cache" ) ? nullptr : &cache };
 
     using namespace std::placeholders;
+    int result;
     if ( opts.has( "peak-only" ) ) {
-        return checked_invoke( opts, std::array{ "input" }, print_peak );
+        auto print = opts.has( "per-channel" ) ? print_channel_peaks : print_peak;
+        result = checked_invoke( opts, std::array{ "input" }, std::bind( print, _1, source ) );
     } else {
-        return checked_invoke_in_out( opts, std::bind( normalize, _1, _2, db_to_amp( level ) ) );
+        result = checked_invoke_batch( opts, std::array{ "input", "output" }, batch,
+                                       std::bind( normalize, _1, _2, db_to_amp( level ),
+                                                  opts.has( "pipeline" ), source ) );
+    }
+
+    if ( opts.has( "cache-stats" ) ) {
+        std::cout << "Peak cache: " << cache.hits() << " hits, " << cache.misses() << " misses"
+                  << std::endl;
     }
+    return result;
 }
@@ -0,0 +1,47 @@
+// sfpan's processing, shared with the benchmarks
+#pragma once
+
+#include "breakpoint/breakpoint.hpp"
+#include "util/buffer_arena.hpp"
+#include "util/pan_utils.hpp"
+#include "util/sndfile_utils.hpp"
+#include "util/stereo_envelope_generator.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <span>
+
+inline bool check_pan_range( std::span<const breakpoint::point> points, double min, double max ) {
+    return std::all_of( begin( points ), end( points ),
+                        [min, max]( auto x ) { return x.value >= min && x.value <= max; } );
+}
+
+inline bool pan_copy( SndfileHandle & from,
+                      SndfileHandle & to,
+                      std::span<const breakpoint::point> points,
+                      const size_t bufsize = 1024 ) {
+    if ( !check_pan_range( points, -1.0, 1.0 ) ) {
+        std::cout << "Breakpoints are outside the -1 to +1 range" << std::endl;
+        return false;
+    }
+
+    // borrow enough for stereo
+    auto floats = buffer_arena::shared().borrow( bufsize * 2 );
+    sf_count_t read = 0;
+    sf_count_t total_written = 0;
+    stereo_envelope_generator gen( points, from.samplerate(), bufsize );
+
+    while ( ( read = from.readf( floats.data(), bufsize ) ) ) {
+        pan_mono_in_place( floats.samples(), gen.next_frames( read ), read );
+        auto written = to.writef( floats.data(), read );
+        if ( written < read ) {
+            std::cout << "Error while writing (" << written << " written): " << to.strError()
+                      << std::endl;
+            return false;
+        }
+
+        total_written += written;
+    }
+
+    return check_read_all( from, total_written );
+}
@@ -1,10 +1,12 @@
 // print out properties of a sound file
 #include <filesystem>
+#include <functional>
 #include <iostream>
 #include <string>
 
 #include "wrapsndfile.hpp"
 
+#include "sfprop/sfprop.hpp"
 #include "util/checked_invoke.hpp"
 #include "util/sndfile_utils.hpp"
 
@@ -16,13 +18,13 @@ std::string try_get_value_property( WrapSndfile::sndfile & sf,
                                     const SndfileValuePropertyFun func ) {
     double val = 0.0;
     if ( ( sf.*func )( val ) ) {
-        return std::to_string( val ) + " (" + std::to_string( amp_to_db( val ) ) + " dB)";
+        return format_amplitude( val );
     } else {
         return "not found"s;
     }
 }
 
-static bool print_properties( const std::string & path ) noexcept {
+static bool print_properties( const std::string & path, peak_cache * cache ) noexcept {
     WrapSndfile::sndfile sf( path, SFM_READ );
     if ( !sf ) {
         std::cout << "Couldn't open file: " << path;
@@ -42,10 +44,7 @@ static bool print_properties( const std::string & path ) noexcept {
     cout << "Sample Rate:     " << sf.samplerate() << endl;
     cout << "In-file Peak:    " << try_get_value_property( sf, &WrapSndfile::sndfile::getPeak )
          << endl;
-    cout << "Calculated Peak: " << try_get_value_property( sf, &WrapSndfile::sndfile::calcPeak )
-         << endl;
-    cout << "Calc Norm Peak:  "
-         << try_get_value_property( sf, &WrapSndfile::sndfile::calcNormalizedPeak ) << endl;
+    print_calculated_stats( cout, path, cache );
     cout << divider << '\n' << endl;
 
     auto const fields = {
@@ -67,8 +66,28 @@ static bool print_properties( const std::string & path ) noexcept {
 int main( int argc, char ** argv ) {
     simple_options::options opts{ "sfprop" };
     opts.basic_option( "help,h", "Print description and exit" )
+        .basic_option( "cache",
+                       "Use the peak cache next to the input file, writing an entry there if it "
+                       "has none" )
+        .basic_option( "cache-stats", "With --cache, print peak cache hits and misses when done" )
         .positional( "input", "Input file" )
         .parse( argc, argv );
 
-    return checked_invoke( opts, std::array{ "input" }, &print_properties );
+    if ( opts.has( "cache-stats" ) && !opts.has( "cache" ) && !opts.has( "help" ) ) {
+        std::cout << "--cache-stats needs --cache" << std::endl;
+        return 1;
+    }
+
+    // Only inspects the file, so it leaves no sidecar behind unless asked to
+    peak_cache cache;
+    using namespace std::placeholders;
+    const int result = checked_invoke(
+        opts, std::array{ "input" },
+        std::bind( print_properties, _1, opts.has( "cache" ) ? &cache : nullptr ) );
+
+    if ( opts.has( "cache-stats" ) ) {
+        std::cout << "Peak cache: " << cache.hits() << " hits, " << cache.misses() << " misses"
+                  << std::endl;
+    }
+    return result;
 }
@@ -0,0 +1,47 @@
+// the measured properties sfprop prints: peak and RMS from our own scanner
+#pragma once
+
+#include "util/sample_dispatch.hpp"
+#include "util/sndfile_utils.hpp"
+
+#include <optional>
+#include <ostream>
+#include <string>
+
+inline std::string format_amplitude( double val ) {
+    return std::to_string( val ) + " (" + std::to_string( amp_to_db( val ) ) + " dB)";
+}
+
+inline std::string format_rms( const signal_stats & stats ) {
+    std::string result;
+    for ( auto rms : stats.rms ) {
+        result += ( result.empty() ? "" : ", " ) + std::to_string( amp_to_db( rms ) ) + " dB";
+    }
+    return result;
+}
+
+// The peak in the file's own units (as libsndfile's SFC_CALC_SIGNAL_MAX gives it, e.g. up to 32768
+// for 16-bit PCM), the normalized peak, and the RMS of each channel if known. Uses our own peak
+// scanner rather than extra passes inside libsndfile; with a cache, RMS comes for free. The scanner
+// reads normalized samples, so the peak in file units is scaled back up by the subtype's full
+// scale.
+inline void print_calculated_stats( std::ostream & os,
+                                    const std::string & path,
+                                    peak_cache * cache ) {
+    SndfileHandle handle( path, SFM_READ );
+    const auto stats = handle.error() == SF_ERR_NO_ERROR
+        ? cached_scan_signal( path, handle, cache )
+        : std::nullopt;
+    if ( !stats ) {
+        os << "Calculated Peak: not found\n";
+        os << "Calc Norm Peak:  not found\n";
+        return;
+    }
+
+    os << "Calculated Peak: " << format_amplitude( stats->peak() * full_scale( handle.format() ) )
+       << '\n';
+    os << "Calc Norm Peak:  " << format_amplitude( stats->peak() ) << '\n';
+    if ( !stats->rms.empty() ) {
+        os << "Calculated RMS:  " << format_rms( *stats ) << '\n';
+    }
+}
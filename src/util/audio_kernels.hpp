@@ -0,0 +1,553 @@
+// Vectorized inner loops shared by the audio tools
+#pragma once
+
+#include "util/channel_dispatch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+
+#if ( defined( __x86_64__ ) || defined( __i386__ ) )                                             \
+    && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#define AUDIO_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace audio_kernels {
+
+// Instruction sets a kernel can be run with. `best` picks the widest one this CPU supports.
+enum class isa { best, scalar, sse2, avx2, avx512 };
+
+#ifdef AUDIO_KERNELS_X86
+#define AUDIO_KERNELS_AVX2 __attribute__( ( target( "avx2" ) ) )
+#define AUDIO_KERNELS_AVX512 __attribute__( ( target( "avx512f" ) ) )
+
+inline bool supports( isa set ) noexcept {
+    switch ( set ) {
+    case isa::avx512:
+        return __builtin_cpu_supports( "avx512f" );
+    case isa::avx2:
+        return __builtin_cpu_supports( "avx2" );
+    case isa::sse2:
+        return __builtin_cpu_supports( "sse2" );
+    default:
+        return true;
+    }
+}
+#else
+inline bool supports( isa set ) noexcept {
+    return set == isa::best || set == isa::scalar;
+}
+#endif
+
+// Resolved once; the CPU doesn't change under us.
+inline isa resolve( isa set ) noexcept {
+    if ( set != isa::best )
+        return set;
+
+    static const isa detected = [] {
+        for ( auto candidate : { isa::avx512, isa::avx2, isa::sse2 } )
+            if ( supports( candidate ) )
+                return candidate;
+        return isa::scalar;
+    }();
+    return detected;
+}
+
+namespace detail {
+
+template <size_t Channels>
+void apply_gain_scalar( float * samples, const float * gains, size_t frames ) noexcept {
+    for ( size_t f = 0; f < frames; ++f )
+        for ( size_t c = 0; c < Channels; ++c )
+            samples[f * Channels + c] *= gains[f];
+}
+
+inline void apply_gain_scalar( float * samples,
+                               const float * gains,
+                               size_t frames,
+                               size_t channels ) noexcept {
+    for ( size_t f = 0; f < frames; ++f )
+        for ( size_t c = 0; c < channels; ++c )
+            samples[f * channels + c] *= gains[f];
+}
+
+template <size_t Channels>
+void peak_scalar( const float * samples, size_t frames, float * peaks ) noexcept {
+    for ( size_t f = 0; f < frames; ++f )
+        for ( size_t c = 0; c < Channels; ++c )
+            peaks[c] = std::max( peaks[c], std::abs( samples[f * Channels + c] ) );
+}
+
+inline void peak_scalar( const float * samples,
+                         size_t frames,
+                         size_t channels,
+                         float * peaks ) noexcept {
+    for ( size_t f = 0; f < frames; ++f )
+        for ( size_t c = 0; c < channels; ++c )
+            peaks[c] = std::max( peaks[c], std::abs( samples[f * channels + c] ) );
+}
+
+// `channels` is a size_t or a channel_count; with the latter the loop over channels is unrolled.
+template <class Channels>
+void sum_squares( const float * samples,
+                  size_t frames,
+                  const Channels channels,
+                  double * sums ) noexcept {
+    for ( size_t f = 0; f < frames; ++f )
+        for ( size_t c = 0; c < channels; ++c )
+            sums[c] += double( samples[f * channels + c] ) * samples[f * channels + c];
+}
+
+inline void ramp_scalar( float * out,
+                         size_t n,
+                         double start,
+                         double slope,
+                         double offset ) noexcept {
+    for ( size_t i = 0; i < n; ++i )
+        out[i] = float( start + slope * ( offset + double( i ) ) );
+}
+
+#ifdef AUDIO_KERNELS_X86
+
+// Lane `j` of the `v`th vector in a group of interleaved frames belongs to frame (v*W + j) / C.
+// A group covers lcm(W, C) samples, i.e. lcm(W, C) / C frames.
+constexpr size_t gcd( size_t a, size_t b ) {
+    return b == 0 ? a : gcd( b, a % b );
+}
+
+template <size_t Width, size_t Channels> struct gain_layout {
+    static constexpr size_t group_samples = Width / gcd( Width, Channels ) * Channels;
+    static constexpr size_t group_frames = group_samples / Channels;
+    static constexpr size_t vectors = group_samples / Width;
+
+    struct table {
+        int32_t index[vectors][Width];
+    };
+
+    static constexpr table make_table() {
+        table t{};
+        for ( size_t v = 0; v < vectors; ++v )
+            for ( size_t j = 0; j < Width; ++j )
+                t.index[v][j] = int32_t( ( v * Width + j ) / Channels );
+        return t;
+    }
+
+    alignas( 64 ) static constexpr table permutation = make_table();
+};
+
+// SSE2 is part of the x86-64 baseline, so it needs no target attribute. It has no variable
+// permute, so each channel count gets its own shuffle.
+template <size_t Channels>
+void apply_gain_sse2( float * samples, const float * gains, size_t frames ) noexcept {
+    size_t f = 0;
+    if constexpr ( Channels == 1 ) {
+        for ( ; f + 4 <= frames; f += 4 ) {
+            auto s = _mm_loadu_ps( samples + f );
+            _mm_storeu_ps( samples + f, _mm_mul_ps( s, _mm_loadu_ps( gains + f ) ) );
+        }
+    } else if constexpr ( Channels == 2 ) {
+        for ( ; f + 4 <= frames; f += 4 ) {
+            auto g = _mm_loadu_ps( gains + f );
+            auto * s = samples + f * 2;
+            _mm_storeu_ps( s, _mm_mul_ps( _mm_loadu_ps( s ), _mm_unpacklo_ps( g, g ) ) );
+            _mm_storeu_ps( s + 4, _mm_mul_ps( _mm_loadu_ps( s + 4 ), _mm_unpackhi_ps( g, g ) ) );
+        }
+    } else if constexpr ( Channels == 6 ) {
+        for ( ; f + 2 <= frames; f += 2 ) {
+            auto g0 = _mm_set1_ps( gains[f] );
+            auto g1 = _mm_set1_ps( gains[f + 1] );
+            auto mid = _mm_shuffle_ps( g0, g1, _MM_SHUFFLE( 0, 0, 0, 0 ) );
+            auto * s = samples + f * 6;
+            _mm_storeu_ps( s, _mm_mul_ps( _mm_loadu_ps( s ), g0 ) );
+            _mm_storeu_ps( s + 4, _mm_mul_ps( _mm_loadu_ps( s + 4 ), mid ) );
+            _mm_storeu_ps( s + 8, _mm_mul_ps( _mm_loadu_ps( s + 8 ), g1 ) );
+        }
+    } else {
+        static_assert( Channels % 4 == 0, "no SSE2 kernel for this channel count" );
+        for ( ; f < frames; ++f ) {
+            auto g = _mm_set1_ps( gains[f] );
+            auto * s = samples + f * Channels;
+            for ( size_t c = 0; c < Channels; c += 4 )
+                _mm_storeu_ps( s + c, _mm_mul_ps( _mm_loadu_ps( s + c ), g ) );
+        }
+    }
+
+    apply_gain_scalar<Channels>( samples + f * Channels, gains + f, frames - f );
+}
+
+template <size_t Channels>
+AUDIO_KERNELS_AVX2 void apply_gain_avx2( float * samples,
+                                         const float * gains,
+                                         size_t frames ) noexcept {
+    using layout = gain_layout<8, Channels>;
+    __m256i perm[layout::vectors];
+    for ( size_t v = 0; v < layout::vectors; ++v )
+        perm[v] = _mm256_load_si256(
+            reinterpret_cast<const __m256i *>( layout::permutation.index[v] ) );
+
+    size_t f = 0;
+    // Always load a full vector of gains, so stay a whole vector away from the end.
+    for ( ; f + 8 <= frames; f += layout::group_frames ) {
+        auto g = _mm256_loadu_ps( gains + f );
+        auto * s = samples + f * Channels;
+        for ( size_t v = 0; v < layout::vectors; ++v ) {
+            auto expanded = _mm256_permutevar8x32_ps( g, perm[v] );
+            _mm256_storeu_ps( s + v * 8, _mm256_mul_ps( _mm256_loadu_ps( s + v * 8 ), expanded ) );
+        }
+    }
+
+    apply_gain_scalar<Channels>( samples + f * Channels, gains + f, frames - f );
+}
+
+template <size_t Channels>
+AUDIO_KERNELS_AVX512 void apply_gain_avx512( float * samples,
+                                             const float * gains,
+                                             size_t frames ) noexcept {
+    using layout = gain_layout<16, Channels>;
+    __m512i perm[layout::vectors];
+    for ( size_t v = 0; v < layout::vectors; ++v )
+        perm[v] = _mm512_load_si512( layout::permutation.index[v] );
+
+    size_t f = 0;
+    for ( ; f + 16 <= frames; f += layout::group_frames ) {
+        auto g = _mm512_loadu_ps( gains + f );
+        auto * s = samples + f * Channels;
+        for ( size_t v = 0; v < layout::vectors; ++v ) {
+            // Two-source form of the permute: every index is < 16, so only `g` is read.
+            auto expanded = _mm512_permutex2var_ps( g, perm[v], g );
+            _mm512_storeu_ps( s + v * 16,
+                              _mm512_mul_ps( _mm512_loadu_ps( s + v * 16 ), expanded ) );
+        }
+    }
+
+    apply_gain_scalar<Channels>( samples + f * Channels, gains + f, frames - f );
+}
+
+// The peak kernels keep one running maximum per vector of a gain_layout group. Since a group is a
+// whole number of frames, lane j of accumulator v always holds channel (v*W + j) % C.
+template <size_t Width, size_t Channels>
+void fold_peaks( const float ( &lanes )[gain_layout<Width, Channels>::group_samples],
+                 float * peaks ) noexcept {
+    for ( size_t k = 0; k < gain_layout<Width, Channels>::group_samples; ++k )
+        peaks[k % Channels] = std::max( peaks[k % Channels], lanes[k] );
+}
+
+template <size_t Channels>
+void peak_sse2( const float * samples, size_t frames, float * peaks ) noexcept {
+    using layout = gain_layout<4, Channels>;
+    const auto mask = _mm_castsi128_ps( _mm_set1_epi32( 0x7fffffff ) );
+    __m128 acc[layout::vectors];
+    for ( auto & a : acc )
+        a = _mm_setzero_ps();
+
+    size_t f = 0;
+    for ( ; f + layout::group_frames <= frames; f += layout::group_frames ) {
+        const auto * s = samples + f * Channels;
+        for ( size_t v = 0; v < layout::vectors; ++v )
+            acc[v] = _mm_max_ps( acc[v], _mm_and_ps( _mm_loadu_ps( s + v * 4 ), mask ) );
+    }
+
+    float lanes[layout::group_samples];
+    for ( size_t v = 0; v < layout::vectors; ++v )
+        _mm_storeu_ps( lanes + v * 4, acc[v] );
+    fold_peaks<4, Channels>( lanes, peaks );
+    peak_scalar<Channels>( samples + f * Channels, frames - f, peaks );
+}
+
+template <size_t Channels>
+AUDIO_KERNELS_AVX2 void peak_avx2( const float * samples, size_t frames, float * peaks ) noexcept {
+    using layout = gain_layout<8, Channels>;
+    const auto mask = _mm256_castsi256_ps( _mm256_set1_epi32( 0x7fffffff ) );
+    __m256 acc[layout::vectors];
+    for ( auto & a : acc )
+        a = _mm256_setzero_ps();
+
+    size_t f = 0;
+    for ( ; f + layout::group_frames <= frames; f += layout::group_frames ) {
+        const auto * s = samples + f * Channels;
+        for ( size_t v = 0; v < layout::vectors; ++v )
+            acc[v] = _mm256_max_ps( acc[v], _mm256_and_ps( _mm256_loadu_ps( s + v * 8 ), mask ) );
+    }
+
+    float lanes[layout::group_samples];
+    for ( size_t v = 0; v < layout::vectors; ++v )
+        _mm256_storeu_ps( lanes + v * 8, acc[v] );
+    fold_peaks<8, Channels>( lanes, peaks );
+    peak_scalar<Channels>( samples + f * Channels, frames - f, peaks );
+}
+
+template <size_t Channels>
+AUDIO_KERNELS_AVX512 void peak_avx512( const float * samples,
+                                       size_t frames,
+                                       float * peaks ) noexcept {
+    using layout = gain_layout<16, Channels>;
+    __m512 acc[layout::vectors];
+    for ( auto & a : acc )
+        a = _mm512_setzero_ps();
+
+    size_t f = 0;
+    for ( ; f + layout::group_frames <= frames; f += layout::group_frames ) {
+        const auto * s = samples + f * Channels;
+        for ( size_t v = 0; v < layout::vectors; ++v )
+            acc[v] = _mm512_max_ps( acc[v], _mm512_abs_ps( _mm512_loadu_ps( s + v * 16 ) ) );
+    }
+
+    float lanes[layout::group_samples];
+    for ( size_t v = 0; v < layout::vectors; ++v )
+        _mm512_storeu_ps( lanes + v * 16, acc[v] );
+    fold_peaks<16, Channels>( lanes, peaks );
+    peak_scalar<Channels>( samples + f * Channels, frames - f, peaks );
+}
+
+// Four frames at a time in double precision, then narrowed. Uses separate multiply and add (no
+// FMA) so the result is bit-identical to ramp_scalar.
+AUDIO_KERNELS_AVX2 inline void ramp_avx2( float * out,
+                                          size_t n,
+                                          double start,
+                                          double slope,
+                                          double offset ) noexcept {
+    const auto vstart = _mm256_set1_pd( start );
+    const auto vslope = _mm256_set1_pd( slope );
+    const auto step = _mm256_set1_pd( 4.0 );
+    auto pos = _mm256_add_pd( _mm256_set1_pd( offset ), _mm256_setr_pd( 0.0, 1.0, 2.0, 3.0 ) );
+
+    size_t i = 0;
+    for ( ; i + 4 <= n; i += 4 ) {
+        auto val = _mm256_add_pd( vstart, _mm256_mul_pd( vslope, pos ) );
+        _mm_storeu_ps( out + i, _mm256_cvtpd_ps( val ) );
+        pos = _mm256_add_pd( pos, step );
+    }
+
+    for ( ; i < n; ++i )
+        out[i] = float( start + slope * ( offset + double( i ) ) );
+}
+
+#endif // AUDIO_KERNELS_X86
+
+template <size_t Channels>
+void apply_gain( float * samples, const float * gains, size_t frames, isa set ) noexcept {
+#ifdef AUDIO_KERNELS_X86
+    switch ( set ) {
+    case isa::avx512:
+        return apply_gain_avx512<Channels>( samples, gains, frames );
+    case isa::avx2:
+        return apply_gain_avx2<Channels>( samples, gains, frames );
+    case isa::sse2:
+        return apply_gain_sse2<Channels>( samples, gains, frames );
+    default:
+        break;
+    }
+#endif
+    (void)set;
+    apply_gain_scalar<Channels>( samples, gains, frames );
+}
+
+template <size_t Channels>
+void peak( const float * samples, size_t frames, float * peaks, isa set ) noexcept {
+#ifdef AUDIO_KERNELS_X86
+    switch ( set ) {
+    case isa::avx512:
+        return peak_avx512<Channels>( samples, frames, peaks );
+    case isa::avx2:
+        return peak_avx2<Channels>( samples, frames, peaks );
+    case isa::sse2:
+        return peak_sse2<Channels>( samples, frames, peaks );
+    default:
+        break;
+    }
+#endif
+    (void)set;
+    peak_scalar<Channels>( samples, frames, peaks );
+}
+
+} // namespace detail
+
+// Fills `out` with out[i] = start + slope * (offset + i). The result does not depend on `set`.
+inline void ramp( std::span<float> out,
+                  double start,
+                  double slope,
+                  double offset,
+                  isa set = isa::best ) noexcept {
+#ifdef AUDIO_KERNELS_X86
+    if ( auto resolved = resolve( set ); resolved == isa::avx2 || resolved == isa::avx512 )
+        return detail::ramp_avx2( out.data(), out.size(), start, slope, offset );
+#endif
+    (void)set;
+    detail::ramp_scalar( out.data(), out.size(), start, slope, offset );
+}
+
+// Multiplies every sample of each frame in the interleaved buffer `samples` by the matching entry
+// of `gains`, which must hold at least samples.size() / channels values. 1, 2, 4, 6 and 8 channels
+// have vectorized kernels; anything else uses a plain loop.
+template <size_t Channels>
+void apply_gain_envelope( std::span<float> samples,
+                          std::span<const float> gains,
+                          channel_count<Channels>,
+                          isa set = isa::best ) noexcept {
+    detail::apply_gain<Channels>( samples.data(), gains.data(), samples.size() / Channels,
+                                  resolve( set ) );
+}
+
+inline void apply_gain_envelope( std::span<float> samples,
+                                 std::span<const float> gains,
+                                 int channels,
+                                 isa set = isa::best ) noexcept {
+    dispatch_channels( size_t( channels ), [&]( auto c ) {
+        if constexpr ( is_channel_count_v<decltype( c )> )
+            apply_gain_envelope( samples, gains, c, set );
+        else
+            detail::apply_gain_scalar( samples.data(), gains.data(), samples.size() / c, c );
+    } );
+}
+
+// Raises each entry of `peaks` (one per channel) to the largest absolute sample value of that
+// channel in the interleaved buffer `samples`. Same channel counts as apply_gain_envelope.
+inline void accumulate_peaks( std::span<const float> samples,
+                              std::span<float> peaks,
+                              isa set = isa::best ) noexcept {
+    set = resolve( set );
+    dispatch_channels( peaks.size(), [&]( auto c ) {
+        const size_t frames = samples.size() / c;
+        if constexpr ( is_channel_count_v<decltype( c )> )
+            detail::peak<decltype( c )::value>( samples.data(), frames, peaks.data(), set );
+        else
+            detail::peak_scalar( samples.data(), frames, c, peaks.data() );
+    } );
+}
+
+// Adds the square of each sample in the interleaved buffer `samples` to the entry of `sums` for its
+// channel. Accumulates in double, so long files don't lose the small contributions.
+inline void accumulate_squares( std::span<const float> samples, std::span<double> sums ) noexcept {
+    dispatch_channels( sums.size(), [&]( auto c ) {
+        detail::sum_squares( samples.data(), samples.size() / c, c, sums.data() );
+    } );
+}
+
+// Other sample types
+//
+// Files can also be processed in the type they are stored in (see sample_dispatch.hpp). Gains on
+// short and int samples are applied in fixed point, rounded to nearest and saturated to the type's
+// range, so integer PCM doesn't make a round trip through float. Double samples are multiplied as
+// they are. A NaN or infinite gain has no integer result, so it leaves short and int samples as
+// they are.
+
+namespace detail {
+
+// Gains this large in magnitude or larger are applied in double, since their fixed-point multiplier
+// times an int sample could overflow 63 bits
+inline constexpr double max_fixed_gain = 2147483648.0;
+
+// A gain below max_fixed_gain as multiplier / 2^shift. The multiplier is at most 2^31, so its
+// product with an int sample fits 63 bits, and it holds a float gain's 24 significant bits exactly.
+// Gains too small to move an int sample by half a step share the largest shift.
+struct fixed_gain {
+    int64_t multiplier;
+    int shift;
+    int64_t half;
+
+    explicit fixed_gain( const double gain ) noexcept {
+        int exponent;
+        std::frexp( gain, &exponent );
+        shift = std::clamp( 30 - exponent, 0, 62 );
+        multiplier = int64_t( std::llrint( std::ldexp( gain, shift ) ) );
+        half = shift ? int64_t( 1 ) << ( shift - 1 ) : 0;
+    }
+
+    template <class Sample> int64_t operator()( const Sample x ) const noexcept {
+        return ( x * multiplier + half ) >> shift;
+    }
+};
+
+template <class Sample> Sample saturate( const int64_t x ) noexcept {
+    return Sample( std::clamp<int64_t>( x, std::numeric_limits<Sample>::min(),
+                                        std::numeric_limits<Sample>::max() ) );
+}
+
+// x * gain for a finite gain, rounded and saturated like the fixed-point path
+template <class Sample> Sample scale_saturate( const Sample x, const double gain ) noexcept {
+    return Sample( std::clamp( std::floor( x * gain + 0.5 ),
+                               double( std::numeric_limits<Sample>::min() ),
+                               double( std::numeric_limits<Sample>::max() ) ) );
+}
+
+// `samples` holds `count` samples. Each is scaled on its own, so the result doesn't depend on what
+// else is in the buffer.
+template <class Sample, class Count>
+void apply_gain_fixed( Sample * samples, const Count count, const double gain ) noexcept {
+    if ( !std::isfinite( gain ) )
+        return;
+    if ( std::abs( gain ) >= max_fixed_gain ) {
+        for ( size_t i = 0; i < size_t( count ); ++i )
+            samples[i] = scale_saturate( samples[i], gain );
+        return;
+    }
+
+    const fixed_gain fixed( gain );
+    for ( size_t i = 0; i < size_t( count ); ++i )
+        samples[i] = saturate<Sample>( fixed( samples[i] ) );
+}
+
+// Each frame's gain gets its own multiplier and shift, so frames are scaled exactly as they would
+// be alone, whichever block or chunk they fall in
+template <class Sample, class Channels>
+void apply_gain_envelope_fixed( Sample * samples,
+                                const float * gains,
+                                size_t frames,
+                                const Channels channels ) noexcept {
+    for ( size_t f = 0; f < frames; ++f )
+        apply_gain_fixed( samples + f * channels, channels, double( gains[f] ) );
+}
+
+} // namespace detail
+
+// Multiplies every sample by `gain`
+inline void apply_gain( std::span<float> samples, const float gain ) noexcept {
+    std::transform( samples.begin(), samples.end(), samples.begin(),
+                    [gain]( auto x ) { return x * gain; } );
+}
+
+inline void apply_gain( std::span<double> samples, const double gain ) noexcept {
+    std::transform( samples.begin(), samples.end(), samples.begin(),
+                    [gain]( auto x ) { return x * gain; } );
+}
+
+inline void apply_gain( std::span<short> samples, const double gain ) noexcept {
+    detail::apply_gain_fixed( samples.data(), samples.size(), gain );
+}
+
+inline void apply_gain( std::span<int> samples, const double gain ) noexcept {
+    detail::apply_gain_fixed( samples.data(), samples.size(), gain );
+}
+
+// As apply_gain_envelope on floats. `channels` is an int or a channel_count.
+template <class Channels>
+void apply_gain_envelope( std::span<double> samples,
+                          std::span<const float> gains,
+                          const Channels channels ) noexcept {
+    const size_t frames = samples.size() / channels;
+    for ( size_t f = 0; f < frames; ++f )
+        for ( size_t c = 0; c < size_t( channels ); ++c )
+            samples[f * channels + c] *= gains[f];
+}
+
+template <class Channels>
+void apply_gain_envelope( std::span<short> samples,
+                          std::span<const float> gains,
+                          const Channels channels ) noexcept {
+    detail::apply_gain_envelope_fixed( samples.data(), gains.data(), samples.size() / channels,
+                                       channels );
+}
+
+template <class Channels>
+void apply_gain_envelope( std::span<int> samples,
+                          std::span<const float> gains,
+                          const Channels channels ) noexcept {
+    detail::apply_gain_envelope_fixed( samples.data(), gains.data(), samples.size() / channels,
+                                       channels );
+}
+
+} // namespace audio_kernels
@@ -11,16 +11,29 @@ public:
     // Points: breakpoint envelope. Assumed to start from time 0. No assumption made about last
     // time. Sample rate: used for conversion from seconds to samples. Bufsize: max number of frames
     // that will be requested at one time.
-    basic_envelope_generator( const breakpoint::point_list & points,
+    basic_envelope_generator( std::span<const breakpoint::point> points,
                               const uint32_t sample_rate,
                               const size_t bufsize ):
         Base(points, sample_rate, bufsize, 0.f) {
     }
 
+    basic_envelope_generator( std::initializer_list<breakpoint::point> points,
+                              const uint32_t sample_rate,
+                              const size_t bufsize ):
+        basic_envelope_generator( std::span( points.begin(), points.size() ), sample_rate,
+                                  bufsize ) {
+    }
+
+    // Reads the points off `points` as they are needed; see envelop_generator_base.
+    basic_envelope_generator( breakpoint::point_stream points,
+                              const uint32_t sample_rate,
+                              const size_t bufsize ):
+        Base( std::move( points ), sample_rate, bufsize, 0.f ) {
+    }
+
 private:
     friend Base;
     void generate_frames( std::vector<float>& buffer, const size_t index, const size_t n ) noexcept {
-        for ( size_t i = 0; i < n; ++i )
-            buffer[i] = val_at( index + i );
+        render_values( buffer.data(), index, n );
     }
 };
@@ -0,0 +1,175 @@
+// running a tool over many files in one process
+#pragma once
+
+#include "util/job_output.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <istream>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// The arguments for one run of a tool, e.g. its input and output paths
+using batch_job = std::vector<std::string>;
+
+// Reads jobs of `fields` arguments each, one job per line. Fields are separated by tabs, so that
+// paths can contain spaces, or by spaces on lines without a tab. Blank lines and lines starting
+// with '#' are skipped. Returns nothing (after a message naming the line) if a line has the wrong
+// number of fields.
+inline std::optional<std::vector<batch_job>> parse_manifest( std::istream & in,
+                                                             const size_t fields ) {
+    std::vector<batch_job> jobs;
+    std::string line;
+    for ( size_t line_number = 1; std::getline( in, line ); ++line_number ) {
+        if ( !line.empty() && line.back() == '\r' )
+            line.pop_back();
+        if ( line.find_first_not_of( " \t" ) == std::string::npos || line.front() == '#' )
+            continue;
+
+        batch_job job;
+        if ( line.find( '\t' ) != std::string::npos ) {
+            std::istringstream fields_in( line );
+            for ( std::string field; std::getline( fields_in, field, '\t' ); )
+                job.push_back( field );
+        } else {
+            std::istringstream fields_in( line );
+            for ( std::string field; fields_in >> field; )
+                job.push_back( field );
+        }
+
+        if ( job.size() != fields ) {
+            std::cout << "Manifest line " << line_number << " has " << job.size()
+                      << " fields instead of " << fields << std::endl;
+            return std::nullopt;
+        }
+        jobs.push_back( std::move( job ) );
+    }
+    return jobs;
+}
+
+// Holds back what each job writes to `stream` in its current_job_output(), so that jobs running at
+// once don't interleave their messages. Threads that print for no job write through in one piece.
+// Installed on the stream for as long as it exists; the stream's own buffer stays reachable through
+// original().
+class batch_output_capture : public std::streambuf {
+public:
+    explicit batch_output_capture( std::ostream & stream ):
+        _stream( stream ),
+        _original( stream.rdbuf( this ) ) {
+    }
+
+    ~batch_output_capture() {
+        _stream.rdbuf( _original );
+    }
+
+    batch_output_capture( const batch_output_capture & ) = delete;
+    batch_output_capture & operator=( const batch_output_capture & ) = delete;
+
+    // Writes to where the stream wrote before
+    std::ostream & original() noexcept {
+        return _original_stream;
+    }
+
+protected:
+    int_type overflow( int_type ch ) override {
+        if ( !traits_type::eq_int_type( ch, traits_type::eof() ) ) {
+            const char c = traits_type::to_char_type( ch );
+            xsputn( &c, 1 );
+        }
+        return traits_type::not_eof( ch );
+    }
+
+    std::streamsize xsputn( const char * s, std::streamsize n ) override {
+        if ( auto * output = current_job_output() ) {
+            std::lock_guard lock( output->mutex );
+            output->text.append( s, size_t( n ) );
+            return n;
+        }
+        std::lock_guard lock( _mutex );
+        return _original->sputn( s, n );
+    }
+
+private:
+    std::ostream & _stream;
+    std::streambuf * _original;
+    std::ostream _original_stream{ _original };
+    std::mutex _mutex;
+};
+
+struct batch_result {
+    size_t succeeded = 0;
+    size_t failed = 0;
+};
+
+// Calls f(job), which returns whether the job succeeded, for every job on up to `concurrency`
+// threads. Prints a line as each job finishes and a summary at the end with the throughput, taking
+// the first argument of each job to be the file it reads. Jobs are started in order but may finish
+// in any order. With more than one thread, whatever a job prints to std::cout, also from threads
+// it starts with helper_thread(), is held back and printed in one piece right before its line.
+template <class F>
+batch_result run_batch( const std::vector<batch_job> & jobs, const unsigned concurrency, F && f ) {
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+
+    std::atomic<size_t> next_job = 0;
+    std::mutex mutex;
+    batch_result result;
+    uintmax_t bytes = 0;
+    std::ostream * out = &std::cout;
+
+    auto work = [&] {
+        for ( size_t index; ( index = next_job++ ) < jobs.size(); ) {
+            const auto & job = jobs[index];
+            const auto job_start = clock::now();
+            job_output printed;
+            current_job_output() = &printed;
+            const bool ok = f( job );
+            current_job_output() = nullptr;
+            const std::chrono::duration<double> elapsed = clock::now() - job_start;
+
+            std::error_code ec;
+            const auto size = std::filesystem::file_size( job.front(), ec );
+
+            std::lock_guard lock( mutex );
+            ++( ok ? result.succeeded : result.failed );
+            bytes += ec ? 0 : size;
+            *out << printed.text << "[" << result.succeeded + result.failed << "/" << jobs.size()
+                 << "] " << ( ok ? "ok     " : "FAILED " );
+            for ( size_t i = 0; i < job.size(); ++i )
+                *out << ( i ? " " : "" ) << job[i];
+            *out << " (" << elapsed.count() << " s)" << std::endl;
+        }
+    };
+
+    const size_t threads = std::clamp<size_t>( concurrency, 1, std::max<size_t>( jobs.size(), 1 ) );
+    if ( threads > 1 ) {
+        batch_output_capture capture( std::cout );
+        out = &capture.original();
+        std::vector<std::thread> workers;
+        for ( size_t i = 0; i < threads; ++i )
+            workers.emplace_back( work );
+        for ( auto & worker : workers )
+            worker.join();
+        out = &std::cout;
+    } else {
+        work();
+    }
+
+    const std::chrono::duration<double> elapsed = clock::now() - start;
+    std::cout << "Processed " << jobs.size() << " jobs (" << result.failed << " failed) in "
+              << elapsed.count() << " s (" << jobs.size() / elapsed.count() << " jobs/s, "
+              << bytes / 1e6 / elapsed.count() << " MB/s read)" << std::endl;
+    return result;
+}
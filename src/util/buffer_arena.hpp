@@ -0,0 +1,163 @@
+// reusable aligned sample buffers, so processing one file after another doesn't allocate
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <utility>
+#include <vector>
+
+// Hands out sample buffers and takes them back when their lease ends. Processing the next file
+// then reuses the buffers of the last one, so once the arena has grown to the largest working set,
+// borrowing doesn't touch the heap at all. Buffers are aligned for the widest vector kernels. Safe
+// to borrow from on several threads.
+class buffer_arena {
+    struct aligned_delete {
+        void operator()( float * p ) const noexcept {
+            ::operator delete( p, std::align_val_t{ alignment } );
+        }
+    };
+
+    struct buffer {
+        std::unique_ptr<float[], aligned_delete> data;
+        size_t capacity = 0;
+    };
+
+public:
+    static constexpr size_t alignment = 64;
+
+    // A buffer on loan from an arena; goes back to it when destroyed. Not cleared between loans.
+    class lease {
+    public:
+        lease() = default;
+
+        ~lease() {
+            if ( _arena )
+                _arena->give_back( std::move( _buffer ) );
+        }
+
+        // Noncopyable since the loan is owned. Can still move though.
+        lease( const lease & ) = delete;
+        lease & operator=( const lease & ) = delete;
+
+        lease( lease && other ) noexcept:
+            _arena( std::exchange( other._arena, nullptr ) ),
+            _buffer( std::move( other._buffer ) ),
+            _size( std::exchange( other._size, 0 ) ) {
+        }
+
+        lease & operator=( lease && other ) noexcept {
+            std::swap( _arena, other._arena );
+            std::swap( _buffer, other._buffer );
+            std::swap( _size, other._size );
+            return *this;
+        }
+
+        float * data() const noexcept {
+            return _buffer.data.get();
+        }
+
+        // What was asked for; the buffer underneath may be bigger
+        size_t size() const noexcept {
+            return _size;
+        }
+
+        std::span<float> samples() const noexcept {
+            return { data(), _size };
+        }
+
+        // The buffer as samples of another type; see borrow_as
+        template <class Sample> Sample * data_as() const noexcept {
+            return reinterpret_cast<Sample *>( data() );
+        }
+
+    private:
+        friend class buffer_arena;
+
+        lease( buffer_arena * arena, buffer b, size_t size ) noexcept:
+            _arena( arena ),
+            _buffer( std::move( b ) ),
+            _size( size ) {
+        }
+
+        buffer_arena * _arena = nullptr;
+        buffer _buffer;
+        size_t _size = 0;
+    };
+
+    buffer_arena() = default;
+    buffer_arena( const buffer_arena & ) = delete;
+    buffer_arena & operator=( const buffer_arena & ) = delete;
+
+    // The arena the audio tools share
+    static buffer_arena & shared() {
+        static buffer_arena arena;
+        return arena;
+    }
+
+    // A buffer of at least `samples` floats: the smallest free one that fits, or a new one if none
+    // does. The arena must outlive the lease.
+    lease borrow( const size_t samples ) {
+        {
+            std::lock_guard lock( _mutex );
+            auto best = _free.end();
+            for ( auto it = _free.begin(); it != _free.end(); ++it ) {
+                if ( it->capacity >= samples
+                     && ( best == _free.end() || it->capacity < best->capacity ) )
+                    best = it;
+            }
+
+            if ( best != _free.end() ) {
+                std::swap( *best, _free.back() );
+                buffer b = std::move( _free.back() );
+                _free.pop_back();
+                return lease( this, std::move( b ), samples );
+            }
+            ++_allocations;
+        }
+
+        // At least one sample, so that every lease has memory behind it
+        const size_t capacity = std::max<size_t>( samples, 1 );
+        auto * p = static_cast<float *>(
+            ::operator new( capacity * sizeof( float ), std::align_val_t{ alignment } ) );
+        return lease( this, buffer{ { p, aligned_delete{} }, capacity }, samples );
+    }
+
+    // A buffer with room for at least `count` samples of type Sample, e.g. short or double for
+    // files processed in their own sample type. Reached through data_as<Sample>(); size() still
+    // counts floats.
+    template <class Sample> lease borrow_as( const size_t count ) {
+        return borrow( ( count * sizeof( Sample ) + sizeof( float ) - 1 ) / sizeof( float ) );
+    }
+
+    // How many buffers this arena has taken from the heap over its lifetime. For checking that
+    // repeated processing only borrows.
+    size_t allocations() const {
+        std::lock_guard lock( _mutex );
+        return _allocations;
+    }
+
+    // Frees the buffers that aren't on loan
+    void release() {
+        std::lock_guard lock( _mutex );
+        _free.clear();
+    }
+
+private:
+    void give_back( buffer b ) noexcept {
+        std::lock_guard lock( _mutex );
+        // Only grows while the arena does, so steady state doesn't allocate here either. If
+        // growing fails, the buffer is simply freed.
+        try {
+            _free.push_back( std::move( b ) );
+        } catch ( ... ) {
+        }
+    }
+
+    mutable std::mutex _mutex;
+    std::vector<buffer> _free;
+    size_t _allocations = 0;
+};
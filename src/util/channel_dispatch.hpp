@@ -0,0 +1,36 @@
+// turning a run-time channel count into a compile-time one
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+// A channel count known at compile time. Converts to size_t, so code written against a plain count
+// works with either.
+template <size_t Channels> using channel_count = std::integral_constant<size_t, Channels>;
+
+template <class T> struct is_channel_count : std::false_type {};
+template <size_t Channels> struct is_channel_count<channel_count<Channels>> : std::true_type {};
+
+template <class T>
+inline constexpr bool is_channel_count_v = is_channel_count<std::remove_cvref_t<T>>::value;
+
+// Calls f(channel_count<N>{}) when `channels` is one of the common layouts (1, 2, 4, 6 or 8), so
+// that loops over the channels inside f are instantiated with a constant bound and can be unrolled,
+// and f(channels) with the plain size_t otherwise. f is typically a generic lambda; all of its
+// instantiations must return the same type.
+template <class F> decltype( auto ) dispatch_channels( const size_t channels, F && f ) {
+    switch ( channels ) {
+    case 1:
+        return f( channel_count<1>{} );
+    case 2:
+        return f( channel_count<2>{} );
+    case 4:
+        return f( channel_count<4>{} );
+    case 6:
+        return f( channel_count<6>{} );
+    case 8:
+        return f( channel_count<8>{} );
+    default:
+        return f( channels );
+    }
+}
@@ -1,10 +1,36 @@
 #pragma once
 
+#include "util/batch.hpp"
 #include "util/simple_options.hpp"
 
 #include <array>
+#include <fstream>
 #include <iostream>
+#include <ostream>
+#include <string>
+#include <string_view>
 #include <tuple>
+#include <vector>
+
+// Where a tool writes an output of "-" that isn't a sound file: stdout, even once
+// keep_stdout_for_output has taken std::cout for messages
+inline std::ostream & stdout_output() noexcept {
+    static std::ostream out( std::cout.rdbuf() );
+    return out;
+}
+
+// An output of "-" is stdout (see is_stdio_path). Messages then go to stderr, so that they don't
+// end up in the middle of the output; stdout stays reachable through stdout_output().
+template <size_t N>
+static void keep_stdout_for_output( const std::array<const char *, N> & arg_names,
+                                    const std::array<std::string, N> & args ) noexcept {
+    for ( size_t i = 0; i < N; ++i ) {
+        if ( std::string_view( arg_names[i] ) == "output" && args[i] == "-" ) {
+            stdout_output().rdbuf( std::cout.rdbuf() );
+            std::cout.rdbuf( std::cerr.rdbuf() );
+        }
+    }
+}
 
 // Expected signature of lambda: bool(std::string x N)
 template <typename F, size_t N>
@@ -23,6 +49,7 @@ template <typename F, size_t N>
         for ( size_t i = 0; i < N; ++i ) {
             args[i] = opts[arg_names[i]].template as<std::string>();
         }
+        keep_stdout_for_output( arg_names, args );
         if ( apply( std::forward<F>( lambda ), args ) ) {
             return 0;
         } else {
@@ -47,3 +74,81 @@ template <typename F>
     return checked_invoke( opts, std::array{ "input", "output", "breakpoints" },
                            std::forward<F>( lambda ) );
 }
+
+// Batch mode: many jobs in one process, so that process startup and option parsing are paid once.
+struct batch_settings {
+    std::string manifest; // file of jobs, one per line; see parse_manifest
+    unsigned jobs = 1;    // how many to run at once
+};
+
+// Adds the batch options, and a positional that takes further groups of arguments after the first.
+// Call after adding the tool's own positionals.
+inline void add_batch_options( simple_options::options & opts, batch_settings & settings ) {
+    opts.stored_option( "manifest", "Also run the jobs listed in this file, one per line",
+                        &settings.manifest )
+        .basic_option( "jobs", "Number of batch jobs to run at once",
+                       simple_options::defaulted_value( &settings.jobs, 1u ) )
+        .unlimited_positional( "more", "Further groups of arguments, each run as another job" );
+}
+
+// Like checked_invoke, but with several jobs (further positional groups or a manifest) calls the
+// lambda once per job on up to `settings.jobs` threads, so it must be safe to call concurrently.
+// Returns 2 if any job failed.
+template <typename F, size_t N>
+[[nodiscard]] static int checked_invoke_batch( simple_options::options & opts,
+                                               const std::array<const char *, N> & arg_names,
+                                               const batch_settings & settings,
+                                               F && lambda ) noexcept {
+    if ( opts.has( "help" ) || ( settings.manifest.empty() && !opts.has( "more" ) ) )
+        return checked_invoke( opts, arg_names, std::forward<F>( lambda ) );
+
+    const auto given = std::count_if( begin( arg_names ), end( arg_names ),
+                                      [&opts]( auto * name ) { return opts.has( name ); } );
+    if ( given != 0 && size_t( given ) != N ) {
+        std::cout << opts;
+        return 1;
+    }
+
+    std::vector<batch_job> jobs;
+    if ( given != 0 ) {
+        batch_job & job = jobs.emplace_back();
+        for ( auto * name : arg_names )
+            job.push_back( opts[name].template as<std::string>() );
+    }
+
+    if ( opts.has( "more" ) ) {
+        const auto more = opts["more"].as<std::vector<std::string>>();
+        if ( more.size() % N != 0 ) {
+            std::cout << "Arguments must come in groups of " << N << std::endl;
+            return 1;
+        }
+        for ( size_t i = 0; i < more.size(); i += N )
+            jobs.emplace_back( more.begin() + i, more.begin() + i + N );
+    }
+
+    if ( !settings.manifest.empty() ) {
+        std::ifstream in( settings.manifest );
+        if ( !in ) {
+            std::cout << "Could not open manifest: " << settings.manifest << std::endl;
+            return 1;
+        }
+        auto listed = parse_manifest( in, N );
+        if ( !listed )
+            return 1;
+        jobs.insert( jobs.end(), listed->begin(), listed->end() );
+    }
+
+    for ( const auto & job : jobs ) {
+        if ( std::find( job.begin(), job.end(), "-" ) != job.end() ) {
+            std::cout << "stdin and stdout can't be used in batch mode" << std::endl;
+            return 1;
+        }
+    }
+
+    auto result = run_batch( jobs, settings.jobs, [&lambda]( const batch_job & job ) {
+        std::array<std::string, N> args;
+        std::copy( job.begin(), job.end(), args.begin() );
+        return bool( apply( lambda, args ) );
+    } );
+    return result.failed ? 2 : 0;
+}
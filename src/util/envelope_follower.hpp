@@ -0,0 +1,172 @@
+// running measurements for following the envelope of a signal
+#pragma once
+
+#include "breakpoint/breakpoint.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+
+// Largest absolute value of the samples currently in a sliding window. Keeps only the samples that
+// could still become the largest, so each sample is added and dropped once: O(1) per sample however
+// long the window is.
+class sliding_peak {
+public:
+    // Adds the next sample. The first one pushed has index 0.
+    void push( float x ) {
+        const float magnitude = std::abs( x );
+        while ( !_candidates.empty() && _candidates.back().magnitude <= magnitude )
+            _candidates.pop_back();
+        _candidates.push_back( { _next++, magnitude } );
+    }
+
+    // Removes the samples with indices before `start` from the window.
+    void drop_before( const uint64_t start ) noexcept {
+        while ( !_candidates.empty() && _candidates.front().index < start )
+            _candidates.pop_front();
+    }
+
+    // 0 for an empty window
+    float value() const noexcept {
+        return _candidates.empty() ? 0.f : _candidates.front().magnitude;
+    }
+
+private:
+    struct candidate {
+        uint64_t index;
+        float magnitude;
+    };
+
+    std::deque<candidate> _candidates; // magnitudes decrease from front to back
+    uint64_t _next = 0;
+};
+
+// RMS of the samples currently in a sliding window, kept as a running sum of squares that samples
+// are added to and taken away from as the window moves: O(1) per sample however long it is.
+class sliding_rms {
+public:
+    // Adds the next sample. The first one pushed has index 0.
+    void push( float x ) {
+        const double square = double( x ) * x;
+        _squares.push_back( square );
+        _sum += square;
+        ++_pushed;
+    }
+
+    // Removes the samples with indices before `start` from the window.
+    void drop_before( const uint64_t start ) noexcept {
+        while ( !_squares.empty() && _pushed - _squares.size() < start ) {
+            _sum -= _squares.front();
+            _squares.pop_front();
+        }
+        // Don't let rounding left over from samples that are gone build up
+        if ( _squares.empty() )
+            _sum = 0.0;
+    }
+
+    // 0 for an empty window
+    float value() const noexcept {
+        if ( _squares.empty() )
+            return 0.f;
+        return float( std::sqrt( std::max( _sum, 0.0 ) / double( _squares.size() ) ) );
+    }
+
+private:
+    std::deque<double> _squares;
+    uint64_t _pushed = 0;
+    double _sum = 0.0;
+};
+
+// Measures windows of `window` samples starting every `hop` samples with Meter (sliding_peak or
+// sliding_rms) as the samples go by, one point per window at the time its window starts. Windows
+// may overlap (hop < window) or leave gaps (hop > window).
+template <class Meter> class windowed_envelope {
+public:
+    windowed_envelope( const uint64_t window,
+                       const uint64_t hop,
+                       const double sample_rate ) noexcept:
+        _window( window ),
+        _hop( hop ),
+        _sample_rate( sample_rate ) {
+    }
+
+    void push( float x ) {
+        _meter.push( x );
+        if ( ++_pushed == _next_start + _window )
+            emit();
+    }
+
+    // Adds points for the windows that start before the end of the signal but run past it,
+    // measured over the samples there are.
+    void finish() {
+        while ( _next_start < _pushed )
+            emit();
+    }
+
+    breakpoint::point_list & points() noexcept {
+        return _points;
+    }
+
+private:
+    void emit() {
+        _meter.drop_before( _next_start );
+        _points.push_back( { double( _next_start ) / _sample_rate, _meter.value() } );
+        _next_start += _hop;
+    }
+
+    Meter _meter;
+    uint64_t _window;
+    uint64_t _hop;
+    double _sample_rate;
+    uint64_t _pushed = 0;
+    uint64_t _next_start = 0;
+    breakpoint::point_list _points;
+};
+
+// Attack/release envelope follower. It rises towards louder samples with the attack time constant
+// and falls back towards quieter ones with the release time constant. With no attack time it jumps
+// straight to each new peak and then decays, i.e. it holds peaks with a release. Its value is
+// sampled every `hop` samples.
+class followed_envelope {
+public:
+    followed_envelope( const double attack_secs,
+                       const double release_secs,
+                       const uint64_t hop,
+                       const double sample_rate ) noexcept:
+        _attack( coefficient( attack_secs, sample_rate ) ),
+        _release( coefficient( release_secs, sample_rate ) ),
+        _hop( hop ),
+        _sample_rate( sample_rate ) {
+    }
+
+    void push( float x ) {
+        const double magnitude = std::abs( x );
+        const double coef = magnitude > _value ? _attack : _release;
+        _value = magnitude + coef * ( _value - magnitude );
+        if ( _pushed % _hop == 0 )
+            _points.push_back( { double( _pushed ) / _sample_rate, _value } );
+        ++_pushed;
+    }
+
+    void finish() noexcept {
+    }
+
+    breakpoint::point_list & points() noexcept {
+        return _points;
+    }
+
+private:
+    // How much of the distance to the target is left after one sample
+    static double coefficient( const double secs, const double sample_rate ) noexcept {
+        return secs > 0.0 ? std::exp( -1.0 / ( secs * sample_rate ) ) : 0.0;
+    }
+
+    double _attack;
+    double _release;
+    uint64_t _hop;
+    double _sample_rate;
+    double _value = 0.0;
+    uint64_t _pushed = 0;
+    breakpoint::point_list _points;
+};
@@ -1,9 +1,13 @@
 #pragma once
 
 #include "breakpoint/breakpoint.hpp"
+#include "util/audio_kernels.hpp"
 
+#include <algorithm>
 #include <cstdint>
+#include <optional>
 #include <span>
+#include <vector>
 
 // A general purpose breakpoint envelope generator.
 
@@ -12,19 +16,30 @@ public:
     // Points: breakpoint envelope. Assumed to start from time 0. No assumption made about last
     // time. Sample rate: used for conversion from seconds to samples. Bufsize: max number of frames
     // that will be requested at one time.
-    envelop_generator_base( const breakpoint::point_list & points,
+    envelop_generator_base( std::span<const breakpoint::point> points,
                             const uint32_t sample_rate,
                             const size_t bufsize,
                             const float buffer_fill ):
         _buffer( bufsize * Channels, buffer_fill ),
-        _points( make_points( points, sample_rate ) ),
-        _current_point( _points.begin() ),
+        _points( points, sample_rate ),
         _index( 0 ),
         // If there were no points to begin with, _buffer is already filled with zeros.
-        _finalized_frame_count( _points.size() == 0 ? bufsize : 0 ) {
+        _finalized_frame_count( _points.empty() ? bufsize : 0 ) {
     }
 
-    // Noncopyable since we keep a reference to the inside of the vector. Can still move though.
+    // Same, but the points are read off `points` as rendering reaches them, so only two are held
+    // at a time. Seeking backwards reads the stream again from the start.
+    envelop_generator_base( breakpoint::point_stream points,
+                            const uint32_t sample_rate,
+                            const size_t bufsize,
+                            const float buffer_fill ):
+        _buffer( bufsize * Channels, buffer_fill ),
+        _points( std::move( points ), sample_rate ),
+        _index( 0 ),
+        _finalized_frame_count( _points.empty() ? bufsize : 0 ) {
+    }
+
+    // Noncopyable since a streamed envelope owns its file mapping. Can still move though.
     envelop_generator_base( const envelop_generator_base & ) = delete;
     envelop_generator_base & operator=( const envelop_generator_base & ) = delete;
 
@@ -38,22 +53,57 @@ public:
         return std::span<float>( _buffer.data(), n * Channels );
     }
 
+    // Makes the next call to next_frames() start at `frame`. The segment containing it is found by
+    // binary search, so this costs O(log n) in the number of points wherever `frame` is.
+    void seek( const size_t frame ) noexcept {
+        _points.seek( frame );
+        _index = frame;
+        if ( !_points.empty() )
+            _finalized_frame_count = 0;
+    }
+
+    // Same as seek( start ) followed by next_frames( n ).
+    std::span<float> frames_at( const size_t start, const size_t n ) noexcept {
+        if ( n > bufsize() )
+            return {};
+
+        seek( start );
+        return next_frames( n );
+    }
+
+    // The first problem found in a streamed envelope so far, or {success, 0}. Problems past the
+    // frames rendered so far are not looked for. Always {success, 0} for points given up front.
+    breakpoint::parse_error error() const noexcept {
+        return _points.error();
+    }
+
 protected:
-    float val_at( size_t i ) noexcept {
-        if ( next( _current_point ) == end( _points ) ) {
-            return float( _current_point->value );
-        } else {
-            if ( i == next( _current_point )->time_sample ) {
-                _current_point++;
-                if ( next( _current_point ) == end( _points ) ) {
-                    return float( _current_point->value );
-                }
+    // Writes the envelope values for frames [index, index + n) to `out`. Rather than evaluating
+    // each frame on its own, this walks whole segments: the slope of a segment is computed once and
+    // the frames it covers are filled with a ramp. Frames past the last point are filled with its
+    // value.
+    void render_values( float * out, size_t index, const size_t n ) noexcept {
+        const size_t end_index = index + n;
+        while ( index < end_index ) {
+            advance_to( index );
+            const auto & current_point = _points.current();
+            const auto * next_point = _points.following();
+            if ( !next_point ) {
+                std::fill( out, out + ( end_index - index ), float( current_point.value ) );
+                return;
             }
 
-            uint64_t span = next( _current_point )->time_sample - _current_point->time_sample;
-            float interp = float( i - _current_point->time_sample ) / float( span );
-            return ( interp * ( next( _current_point )->value - _current_point->value ) )
-                + _current_point->value;
+            const size_t run = std::min<uint64_t>( next_point->time_sample, end_index ) - index;
+            const double span = double( next_point->time_sample - current_point.time_sample );
+            const double slope = ( next_point->value - current_point.value ) / span;
+            const double offset = double( index - current_point.time_sample );
+
+            // Computed from the segment start rather than accumulated, so that the value at any
+            // frame does not depend on how the frames were split into requests.
+            audio_kernels::ramp( { out, run }, current_point.value, slope, offset );
+
+            out += run;
+            index += run;
         }
     }
 
@@ -66,16 +116,101 @@ private:
         uint64_t time_sample;
         double value;
     };
-    using Points = std::vector<sample_point>;
-
-    Points make_points( const breakpoint::point_list & points, const uint32_t sample_rate ) const
-        noexcept {
-        Points result;
-        result.reserve( points.size() );
-        for ( auto & point : points ) {
-            result.push_back( { uint64_t( point.time_secs * sample_rate ), point.value } );
+
+    // The points in time order, converted to frames, with a position in them. Either holds all of
+    // them, or when streaming a window of the current point and the one after it.
+    class point_cursor {
+    public:
+        point_cursor( std::span<const breakpoint::point> points,
+                      const uint32_t sample_rate ) noexcept:
+            _sample_rate( sample_rate ) {
+            _points.reserve( points.size() );
+            for ( auto & point : points )
+                _points.push_back( convert( point ) );
+        }
+
+        point_cursor( breakpoint::point_stream stream, const uint32_t sample_rate ) noexcept:
+            _stream( std::move( stream ) ),
+            _sample_rate( sample_rate ) {
+            restart();
+        }
+
+        bool empty() const noexcept {
+            return _points.empty();
+        }
+
+        const sample_point & current() const noexcept {
+            return _points[_current];
+        }
+
+        // nullptr at the last point
+        const sample_point * following() const noexcept {
+            return _current + 1 < _points.size() ? &_points[_current + 1] : nullptr;
+        }
+
+        // Only valid if there is a following point
+        void advance() noexcept {
+            if ( !_stream ) {
+                ++_current;
+            } else if ( auto point = _stream->next() ) {
+                _points[0] = _points[1];
+                _points[1] = convert( *point );
+            } else {
+                ++_current;
+            }
+        }
+
+        // Moves to the last point at or before `frame`, or the first point if there is none.
+        void seek( const uint64_t frame ) noexcept {
+            if ( !_stream ) {
+                auto after = std::upper_bound( _points.begin(), _points.end(), frame,
+                                               []( uint64_t i, const sample_point & point ) {
+                                                   return i < point.time_sample;
+                                               } );
+                _current = after == _points.begin() ? 0 : size_t( after - _points.begin() ) - 1;
+                return;
+            }
+
+            if ( !empty() && frame < current().time_sample )
+                restart();
+            while ( following() && following()->time_sample <= frame )
+                advance();
+        }
+
+        breakpoint::parse_error error() const noexcept {
+            if ( _stream )
+                return _stream->error();
+            return { breakpoint::parse_error::success, 0 };
         }
-        return result;
+
+    private:
+        sample_point convert( const breakpoint::point & point ) const noexcept {
+            return { uint64_t( point.time_secs * _sample_rate ), point.value };
+        }
+
+        void restart() noexcept {
+            _stream->rewind();
+            _points.clear();
+            _current = 0;
+            while ( _points.size() < 2 ) {
+                auto point = _stream->next();
+                if ( !point )
+                    break;
+                _points.push_back( convert( *point ) );
+            }
+        }
+
+        std::vector<sample_point> _points;
+        size_t _current = 0;
+        std::optional<breakpoint::point_stream> _stream;
+        uint32_t _sample_rate;
+    };
+
+    // Moves forward to the segment containing frame `i`. Points that land on the same frame
+    // (zero-length segments) are skipped over.
+    void advance_to( const size_t i ) noexcept {
+        while ( _points.following() && _points.following()->time_sample <= i )
+            _points.advance();
     }
 
     constexpr const Derived * derived() const noexcept {
@@ -95,7 +230,7 @@ private:
         // N.B. this results in wasted work if we are past the end and then we receive requests
         // for 2, 4, 6, etc. frames. The previous frames will be recalculated. However this is
         // unlikely to happen in practice.
-        if ( next( _current_point ) == end( _points ) )
+        if ( !_points.following() )
             _finalized_frame_count = n;
 
         derived()->generate_frames( _buffer, _index, n );
@@ -103,8 +238,7 @@ private:
     }
 
     std::vector<float> _buffer; // .size() is used to hold bufsize
-    Points _points;
-    typename Points::const_iterator _current_point;
+    point_cursor _points;
     size_t _index;
     // used to indicate whether any more samples need to be dynamically calculated
     size_t _finalized_frame_count;
@@ -0,0 +1,31 @@
+// what a job prints, kept together across the threads it runs on
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+// Text printed on behalf of one job, by the thread running it and by any helpers it starts
+struct job_output {
+    std::mutex mutex;
+    std::string text;
+};
+
+// The job the calling thread prints for, or null if its printing isn't held back
+inline job_output *& current_job_output() noexcept {
+    thread_local job_output * output = nullptr;
+    return output;
+}
+
+// Starts a thread running f(args...) that prints for the same job as the calling thread. Threads a
+// tool starts for its work should be made with this, so that a batch keeps their messages with the
+// job's own.
+template <class F, class... Args> std::thread helper_thread( F && f, Args &&... args ) {
+    return std::thread(
+        [output = current_job_output(), f = std::forward<F>( f )]( auto &&... args ) mutable {
+            current_job_output() = output;
+            f( std::forward<decltype( args )>( args )... );
+        },
+        std::forward<Args>( args )... );
+}
@@ -0,0 +1,74 @@
+// read-only memory mapping of a whole file
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class mapped_file {
+public:
+    mapped_file() = default;
+
+    // Maps the file at `path`. On failure (including an empty file) the result converts to false.
+    explicit mapped_file( const std::string & path ) noexcept {
+        int fd = ::open( path.c_str(), O_RDONLY );
+        if ( fd == -1 )
+            return;
+
+        struct stat st;
+        if ( ::fstat( fd, &st ) == 0 && st.st_size > 0 ) {
+            void * addr = ::mmap( nullptr, size_t( st.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 );
+            if ( addr != MAP_FAILED ) {
+                _data = static_cast<const std::byte *>( addr );
+                _size = size_t( st.st_size );
+            }
+        }
+
+        // The mapping stays valid after the descriptor is closed.
+        ::close( fd );
+    }
+
+    ~mapped_file() {
+        if ( _data )
+            ::munmap( const_cast<std::byte *>( _data ), _size );
+    }
+
+    // Noncopyable since the mapping is owned. Can still move though.
+    mapped_file( const mapped_file & ) = delete;
+    mapped_file & operator=( const mapped_file & ) = delete;
+
+    mapped_file( mapped_file && other ) noexcept:
+        _data( std::exchange( other._data, nullptr ) ),
+        _size( std::exchange( other._size, 0 ) ) {
+    }
+
+    mapped_file & operator=( mapped_file && other ) noexcept {
+        std::swap( _data, other._data );
+        std::swap( _size, other._size );
+        return *this;
+    }
+
+    explicit operator bool() const noexcept {
+        return _data != nullptr;
+    }
+
+    std::span<const std::byte> bytes() const noexcept {
+        return { _data, _size };
+    }
+
+    // Tells the kernel the mapping will be read front to back, so it can read ahead aggressively.
+    void advise_sequential() const noexcept {
+        if ( _data )
+            ::madvise( const_cast<std::byte *>( _data ), _size, MADV_SEQUENTIAL );
+    }
+
+private:
+    const std::byte * _data = nullptr;
+    size_t _size = 0;
+};
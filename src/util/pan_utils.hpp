@@ -1,15 +1,22 @@
 // panning utilities
 #pragma once
 
+#include "util/audio_kernels.hpp"
 #include "util/math_utils.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <span>
+#include <vector>
 
 template <typename F> struct pan_pair {
     F left;
     F right;
 };
 
+// Gains for `position`, from -1 (hard left) to +1 (hard right). Positions outside that range are not
+// clamped here, so the law carries on past the edges and one gain turns negative. pan_law_table
+// clamps them to -1 or +1 instead, and treats NaN as the centre.
 template <typename F> pan_pair<F> constant_power_pan( double position ) {
     using namespace audio_math;
 
@@ -20,3 +27,140 @@ template <typename F> pan_pair<F> constant_power_pan( double position ) {
     return { F( root_two_div_two() * ( cos_angle - sin_angle ) ),
              F( root_two_div_two() * ( cos_angle + sin_angle ) ) };
 }
+
+// Constant power pan law read from a lookup table with linear interpolation, so that panning
+// doesn't cost a sin and a cos per frame. The table is the smallest power of two size that keeps
+// the interpolation error under `max_error` (float rounding adds up to about 1e-7 on top of that).
+// Positions landing exactly on a table entry, including -1, 0 and 1, give exactly
+// constant_power_pan<float>(). Positions outside -1 to +1 are clamped, and NaN is panned to the
+// centre, whichever instruction set is used.
+class pan_law_table {
+public:
+    explicit pan_law_table( double max_error = 1e-6 ):
+        _intervals( intervals_for( max_error ) ),
+        _scale( float( _intervals ) / 2.f ) {
+        // One extra entry past +1 so that position +1 can interpolate without a special case.
+        _table.reserve( _intervals + 2 );
+        for ( size_t i = 0; i <= _intervals; ++i )
+            _table.push_back( constant_power_pan<float>( -1.0 + 2.0 * double( i ) / _intervals ) );
+        _table.push_back( _table.back() );
+    }
+
+    // Shared table at the default accuracy.
+    static const pan_law_table & standard() {
+        static const pan_law_table table;
+        return table;
+    }
+
+    pan_pair<float> operator()( float position ) const noexcept {
+        if ( std::isnan( position ) )
+            position = 0.f;
+        const float x = ( std::clamp( position, -1.f, 1.f ) + 1.f ) * _scale;
+        const size_t i = size_t( x );
+        const float frac = x - float( i );
+        const auto & lo = _table[i];
+        const auto & hi = _table[i + 1];
+        return { lo.left + frac * ( hi.left - lo.left ),
+                 lo.right + frac * ( hi.right - lo.right ) };
+    }
+
+    // Writes the interleaved left/right gains for each of `positions` to `out`, which must hold
+    // 2 * positions.size() values. AVX2 and up look up eight positions at once with gathers; SSE2
+    // has no gather, so it gets the plain loop. The result does not depend on `set`.
+    void pan( std::span<const float> positions,
+              std::span<float> out,
+              audio_kernels::isa set = audio_kernels::isa::best ) const noexcept {
+        size_t i = 0;
+#ifdef AUDIO_KERNELS_X86
+        using audio_kernels::isa;
+        if ( auto resolved = audio_kernels::resolve( set ); resolved == isa::avx2
+                                                            || resolved == isa::avx512 )
+            i = pan_avx2( positions.data(), positions.size(), out.data() );
+#endif
+        (void)set;
+        for ( ; i < positions.size(); ++i ) {
+            auto pair = ( *this )( positions[i] );
+            out[i * 2] = pair.left;
+            out[i * 2 + 1] = pair.right;
+        }
+    }
+
+    // Number of intervals between -1 and +1.
+    size_t intervals() const noexcept {
+        return _intervals;
+    }
+
+private:
+    // Each gain is a quarter cycle of sin or cos over positions -1 to +1, so its second derivative
+    // is at most (pi/4)^2 and linear interpolation over intervals of width h = 2/n is off by at
+    // most h^2/8 * (pi/4)^2 = (pi/4)^2 / (2 n^2).
+    static size_t intervals_for( double max_error ) noexcept {
+        using namespace audio_math;
+        constexpr size_t max_intervals = 1u << 16;
+        const double needed = quarter_pi() / std::sqrt( 2.0 * std::max( max_error, 1e-12 ) );
+        size_t n = 8;
+        while ( n < needed && n < max_intervals )
+            n *= 2;
+        return n;
+    }
+
+#ifdef AUDIO_KERNELS_X86
+    // operator() on eight positions at a time, with the same operations in the same order (no
+    // FMA), so the result is bit-identical. Returns how many positions it did; the rest are left
+    // for the plain loop.
+    AUDIO_KERNELS_AVX2 size_t pan_avx2( const float * positions, size_t n, float * out ) const
+        noexcept {
+        static_assert( sizeof( pan_pair<float> ) == 2 * sizeof( float ) );
+        const auto * table = reinterpret_cast<const float *>( _table.data() );
+        const auto lowest = _mm256_set1_ps( -1.f );
+        const auto one = _mm256_set1_ps( 1.f );
+        const auto scale = _mm256_set1_ps( _scale );
+
+        size_t i = 0;
+        for ( ; i + 8 <= n; i += 8 ) {
+            // NaN lanes compare unordered with themselves, so masking them leaves 0
+            auto position = _mm256_loadu_ps( positions + i );
+            position = _mm256_and_ps( position, _mm256_cmp_ps( position, position, _CMP_ORD_Q ) );
+            auto clamped = _mm256_min_ps( _mm256_max_ps( position, lowest ), one );
+            auto x = _mm256_mul_ps( _mm256_add_ps( clamped, one ), scale );
+            auto index = _mm256_cvttps_epi32( x );
+            auto frac = _mm256_sub_ps( x, _mm256_cvtepi32_ps( index ) );
+
+            // Entry i starts at float 2 * i; entry i + 1 right after it
+            auto at = _mm256_slli_epi32( index, 1 );
+            auto lo_left = _mm256_i32gather_ps( table, at, 4 );
+            auto lo_right = _mm256_i32gather_ps( table + 1, at, 4 );
+            auto hi_left = _mm256_i32gather_ps( table + 2, at, 4 );
+            auto hi_right = _mm256_i32gather_ps( table + 3, at, 4 );
+            auto left
+                = _mm256_add_ps( lo_left, _mm256_mul_ps( frac, _mm256_sub_ps( hi_left, lo_left ) ) );
+            auto right = _mm256_add_ps(
+                lo_right, _mm256_mul_ps( frac, _mm256_sub_ps( hi_right, lo_right ) ) );
+
+            // Unpacking interleaves within each 128-bit half; the permutes put the halves in order
+            auto low = _mm256_unpacklo_ps( left, right );
+            auto high = _mm256_unpackhi_ps( left, right );
+            _mm256_storeu_ps( out + i * 2, _mm256_permute2f128_ps( low, high, 0x20 ) );
+            _mm256_storeu_ps( out + i * 2 + 8, _mm256_permute2f128_ps( low, high, 0x31 ) );
+        }
+        return i;
+    }
+#endif
+
+    size_t _intervals;
+    float _scale;
+    std::vector<pan_pair<float>> _table;
+};
+
+// Pans the mono frames at the start of `buffer` into interleaved stereo in place, using the
+// interleaved left/right `gains` of each frame. `buffer` must have room for 2 * frames values.
+// Works from the last frame back so that no frame is overwritten before it is read.
+inline void pan_mono_in_place( std::span<float> buffer,
+                               std::span<const float> gains,
+                               size_t frames ) noexcept {
+    while ( frames-- != 0 ) {
+        const float sample = buffer[frames];
+        buffer[frames * 2] = sample * gains[frames * 2];
+        buffer[frames * 2 + 1] = sample * gains[frames * 2 + 1];
+    }
+}
@@ -0,0 +1,146 @@
+// remembers scanned peaks so unchanged files don't need to be scanned again
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// What a full scan of a sound file finds out, per channel.
+struct signal_stats {
+    int64_t frames = 0;
+    std::vector<float> peaks;
+    std::vector<double> rms;
+
+    float peak() const noexcept {
+        float result = 0.f;
+        for ( auto p : peaks )
+            result = std::max( result, p );
+        return result;
+    }
+};
+
+// Stores signal_stats in a small text file next to each sound file ("<path>.peaks"). An entry is
+// only used if the sound file still has the size and modification time it had when the entry was
+// written. Counts hits and misses over its lifetime. Can be used from several threads, and by
+// several processes at once.
+class peak_cache {
+public:
+    static std::string sidecar_path( const std::string & path ) {
+        return path + ".peaks";
+    }
+
+    std::optional<signal_stats> lookup( const std::string & path ) {
+        auto result = load( path );
+        ++( result ? _hits : _misses );
+        return result;
+    }
+
+    // Failing to write the sidecar (e.g. in a read-only directory) is not an error; the file just
+    // gets scanned again next time.
+    void store( const std::string & path, const signal_stats & stats ) {
+        auto key = file_key( path );
+        if ( !key )
+            return;
+
+        // Written under a temporary name first so a reader never sees half an entry. The name is
+        // unique so that processes storing entries for the same file don't write over each other.
+        const std::string sidecar = sidecar_path( path );
+        const std::string temp = sidecar + "." + unique_suffix() + ".tmp";
+        bool written;
+        {
+            std::ofstream out( temp );
+            out.precision( std::numeric_limits<double>::max_digits10 );
+            out << magic << ' ' << version << '\n';
+            out << key->size << ' ' << key->mtime << ' ' << stats.frames << ' '
+                << stats.peaks.size() << '\n';
+            for ( size_t c = 0; c < stats.peaks.size(); ++c )
+                out << stats.peaks[c] << ' ' << stats.rms[c] << '\n';
+            out.close();
+            written = bool( out );
+        }
+
+        std::error_code ec;
+        if ( written )
+            std::filesystem::rename( temp, sidecar, ec );
+        if ( !written || ec )
+            std::filesystem::remove( temp, ec );
+    }
+
+    size_t hits() const noexcept {
+        return _hits;
+    }
+
+    size_t misses() const noexcept {
+        return _misses;
+    }
+
+private:
+    static constexpr const char * magic = "tapb-peaks";
+    static constexpr int version = 1;
+    static constexpr size_t max_channels = 1024; // as many as libsndfile opens
+
+    struct key {
+        uintmax_t size;
+        int64_t mtime;
+    };
+
+    static std::string unique_suffix() {
+        std::random_device random;
+        std::ostringstream out;
+        out << std::hex << random() << random();
+        return out.str();
+    }
+
+    static std::optional<key> file_key( const std::string & path ) {
+        std::error_code ec;
+        const auto size = std::filesystem::file_size( path, ec );
+        if ( ec )
+            return std::nullopt;
+        const auto mtime = std::filesystem::last_write_time( path, ec );
+        if ( ec )
+            return std::nullopt;
+        return key{ size, int64_t( mtime.time_since_epoch().count() ) };
+    }
+
+    static std::optional<signal_stats> load( const std::string & path ) {
+        auto current = file_key( path );
+        std::ifstream in( sidecar_path( path ) );
+        if ( !current || !in )
+            return std::nullopt;
+
+        std::string file_magic;
+        int file_version;
+        key stored;
+        size_t channels;
+        signal_stats stats;
+        in >> file_magic >> file_version >> stored.size >> stored.mtime >> stats.frames >> channels;
+        if ( !in || file_magic != magic || file_version != version || stored.size != current->size
+             || stored.mtime != current->mtime )
+            return std::nullopt;
+
+        // The sidecar could be corrupt or written by anyone, so don't size anything off it blindly
+        if ( stats.frames < 0 || channels == 0 || channels > max_channels )
+            return std::nullopt;
+
+        stats.peaks.resize( channels );
+        stats.rms.resize( channels );
+        for ( size_t c = 0; c < channels; ++c )
+            in >> stats.peaks[c] >> stats.rms[c];
+        if ( !in )
+            return std::nullopt;
+
+        return stats;
+    }
+
+    std::atomic<size_t> _hits = 0;
+    std::atomic<size_t> _misses = 0;
+};
@@ -0,0 +1,100 @@
+// picking the sample type to process a file in
+#pragma once
+
+#include "sndfile.h"
+
+#include <type_traits>
+#include <utility>
+
+// The types SndfileHandle reads and writes samples as
+enum class sample_format { int16, int32, float32, float64 };
+
+// Short name of a sample type SndfileHandle reads and writes, for messages
+template <class Sample> constexpr const char * sample_type_name() noexcept {
+    if constexpr ( std::is_same_v<Sample, short> )
+        return "int16";
+    else if constexpr ( std::is_same_v<Sample, int> )
+        return "int32";
+    else if constexpr ( std::is_same_v<Sample, double> )
+        return "double";
+    else
+        return "float";
+}
+
+// How many bits of integer a subtype holds, or 0 if it isn't integer PCM
+inline int integer_bits( const int format ) noexcept {
+    switch ( format & SF_FORMAT_SUBMASK ) {
+    case SF_FORMAT_PCM_S8:
+    case SF_FORMAT_PCM_U8:
+    case SF_FORMAT_PCM_16:
+    case SF_FORMAT_ULAW:
+    case SF_FORMAT_ALAW:
+        return 16;
+    case SF_FORMAT_PCM_24:
+        return 24;
+    case SF_FORMAT_PCM_32:
+        return 32;
+    default:
+        return 0;
+    }
+}
+
+// Full scale of an integer subtype in the file's own units, i.e. what libsndfile divides by when it
+// normalizes: 32768 for 16-bit PCM. 1 for float and double, which are already normalized.
+inline double full_scale( const int format ) noexcept {
+    switch ( format & SF_FORMAT_SUBMASK ) {
+    case SF_FORMAT_PCM_S8:
+    case SF_FORMAT_PCM_U8:
+        return 128.0;
+    case SF_FORMAT_PCM_16:
+    case SF_FORMAT_ULAW:
+    case SF_FORMAT_ALAW:
+        return 32768.0;
+    case SF_FORMAT_PCM_24:
+        return 8388608.0;
+    case SF_FORMAT_PCM_32:
+        return 2147483648.0;
+    default:
+        return 1.0;
+    }
+}
+
+// The cheapest type to copy from a file with format `from` to one with `to` in without losing
+// anything. Integer PCM stays integer when the output is 16 or 32-bit PCM, which libsndfile writes
+// shorts and ints to as they are: in short if the input fits 16 bits, otherwise in int (which
+// libsndfile reads left-justified, so narrower inputs widen exactly). Other integer outputs
+// truncate what they are given, so they go through float, which libsndfile rounds. Double files
+// keep their precision. Everything else goes through float; in particular integer input written
+// to float output, which may go past full scale.
+inline sample_format choose_sample_format( const int from, const int to ) noexcept {
+    const int from_bits = integer_bits( from );
+    const int to_subtype = to & SF_FORMAT_SUBMASK;
+    if ( from_bits && from_bits <= 16 && to_subtype == SF_FORMAT_PCM_16 )
+        return sample_format::int16;
+    if ( from_bits && to_subtype == SF_FORMAT_PCM_32 )
+        return sample_format::int32;
+    if ( ( from & SF_FORMAT_SUBMASK ) == SF_FORMAT_DOUBLE || to_subtype == SF_FORMAT_DOUBLE )
+        return sample_format::float64;
+    return sample_format::float32;
+}
+
+// Calls f(std::type_identity<T>{}) with T the sample type for `format`: short, int, float or
+// double. f is typically a generic lambda that gets the type with
+// `typename decltype( type )::type`; all of its instantiations must return the same type.
+template <class F> decltype( auto ) dispatch_sample_format( const sample_format format, F && f ) {
+    switch ( format ) {
+    case sample_format::int16:
+        return f( std::type_identity<short>{} );
+    case sample_format::int32:
+        return f( std::type_identity<int>{} );
+    case sample_format::float64:
+        return f( std::type_identity<double>{} );
+    default:
+        return f( std::type_identity<float>{} );
+    }
+}
+
+// Dispatches on choose_sample_format( from, to )
+template <class F> decltype( auto ) dispatch_sample_format( const int from, const int to, F && f ) {
+    return dispatch_sample_format( choose_sample_format( from, to ), std::forward<F>( f ) );
+}
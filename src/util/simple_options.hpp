@@ -4,6 +4,8 @@
 #include <boost/program_options.hpp>
 
 #include <optional>
+#include <string>
+#include <vector>
 
 namespace simple_options {
 
@@ -50,9 +52,11 @@ public:
         return *this;
     }
 
-    /// Add a positional argument with an unlimited number of slots.
+    /// Add a positional argument with an unlimited number of slots. Its values are read back as
+    /// a std::vector<std::string>.
     options & unlimited_positional( const char * name, const char * description ) {
-        positional( name, description, -1 );
+        _posl.add( name, -1 );
+        _desc_pos.add_options()( name, value<std::vector<std::string>>(), description );
         return *this;
     }
 
@@ -3,13 +3,32 @@
 
 #include "sndfile.hh"
 
+#include "util/audio_kernels.hpp"
+#include "util/buffer_arena.hpp"
+#include "util/job_output.hpp"
+#include "util/mapped_file.hpp"
+#include "util/peak_cache.hpp"
+#include "util/sample_dispatch.hpp"
+#include "util/virtual_io.hpp"
+#include "util/work_queue.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <span>
 #include <string>
+#include <thread>
+#include <vector>
 
-std::ostream & operator<<( std::ostream & os, const SndfileHandle handle ) {
+inline std::ostream & operator<<( std::ostream & os, const SndfileHandle handle ) {
     os << "Format:      " << handle.format() << std::endl;
     os << "Frames:      " << handle.frames() << std::endl;
     os << "Channels:    " << handle.channels() << std::endl;
@@ -20,17 +39,64 @@ std::ostream & operator<<( std::ostream & os, const SndfileHandle handle ) {
 using Amplitude = float;
 using Loudness = float;
 
-Loudness amp_to_db( Amplitude amp ) {
+inline Loudness amp_to_db( Amplitude amp ) {
     return 20.0 * std::log10( amp );
 }
 
-Amplitude db_to_amp( Loudness ld ) {
+inline Amplitude db_to_amp( Loudness ld ) {
     return std::pow( 10.0, ld / 20.0 );
 }
 
+// Standard streams
+//
+// As an input or output path, "-" stands for stdin or stdout, which libsndfile reads and writes as
+// a pipe. Pipes can't seek, so their length isn't known up front and they can only be read once.
+inline bool is_stdio_path( const std::string & path ) noexcept {
+    return path == "-";
+}
+
+// Whether `handle` can seek. Handles that can't, such as those on a pipe, may not know their
+// length, and frames() is then meaningless.
+inline bool is_seekable( SndfileHandle & handle ) noexcept {
+    SF_INFO info{};
+    handle.command( SFC_GET_CURRENT_SF_INFO, &info, sizeof( info ) );
+    return info.seekable;
+}
+
+// libsndfile can't write WAV, AIFF and most other containers to a pipe, since it goes back to fill
+// in their headers' sizes once the data is written. Output to stdout is AU instead, which can leave
+// the size open, with the same sample type where AU has it and float otherwise.
+inline int stdout_format( const int format, const int chans, const int samplerate ) noexcept {
+    const int type = format & SF_FORMAT_TYPEMASK;
+    if ( type == SF_FORMAT_AU || type == SF_FORMAT_RAW ) {
+        return format;
+    }
+
+    const int au = SF_FORMAT_AU | ( format & SF_FORMAT_SUBMASK );
+    return SndfileHandle::formatCheck( au, chans, samplerate ) ? au
+                                                               : SF_FORMAT_AU | SF_FORMAT_FLOAT;
+}
+
+// Whether reading `frames` frames got through all of `from`, printing a message if not. Without a
+// known length only a read error counts.
+inline bool check_read_all( SndfileHandle & from, const sf_count_t frames ) noexcept {
+    const bool known_length = is_seekable( from );
+    if ( from.error() != SF_ERR_NO_ERROR || ( known_length && frames != from.frames() ) ) {
+        std::cout << "Could not read entire file: " << from.strError() << std::endl;
+        if ( known_length )
+            std::cout << "Read " << frames << " of " << from.frames() << " frames" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
 // Factory methods
-std::unique_ptr<SndfileHandle> make_input_handle( const std::string & path ) noexcept {
-    auto handle = std::make_unique<SndfileHandle>( path, SFM_READ );
+//
+// SndfileHandle is a reference-counted wrapper, so the handles are returned by value rather than
+// allocated.
+inline std::optional<SndfileHandle> make_input_handle( const std::string & path ) noexcept {
+    std::optional<SndfileHandle> handle( std::in_place, path, SFM_READ );
     if ( handle->error() != SF_ERR_NO_ERROR ) {
         std::cout << "Could not open read file: " << path << std::endl;
         return {};
@@ -39,8 +105,8 @@ std::unique_ptr<SndfileHandle> make_input_handle( const std::string & path ) noe
     return handle;
 }
 
-std::unique_ptr<SndfileHandle> require_channels( std::unique_ptr<SndfileHandle> handle,
-                                                 int chans ) noexcept {
+inline std::optional<SndfileHandle> require_channels( std::optional<SndfileHandle> handle,
+                                                     int chans ) noexcept {
     if ( !handle ) {
         return {};
     }
@@ -56,10 +122,11 @@ std::unique_ptr<SndfileHandle> require_channels( std::unique_ptr<SndfileHandle>
 
 constexpr int SF_INPUT_FORMAT = 0;
 constexpr int SF_INPUT_CHANNELS = -1;
-std::unique_ptr<SndfileHandle> make_output_handle( const std::string & path,
-                                                   const std::unique_ptr<SndfileHandle> & in_handle,
-                                                   int format = SF_INPUT_FORMAT,
-                                                   int chans = SF_INPUT_CHANNELS ) noexcept {
+inline std::optional<SndfileHandle>
+make_output_handle( const std::string & path,
+                    const std::optional<SndfileHandle> & in_handle,
+                    int format = SF_INPUT_FORMAT,
+                    int chans = SF_INPUT_CHANNELS ) noexcept {
     if ( !in_handle ) {
         return {};
     }
@@ -72,8 +139,12 @@ std::unique_ptr<SndfileHandle> make_output_handle( const std::string & path,
         chans = in_handle->channels();
     }
 
-    auto out_handle = std::make_unique<SndfileHandle>( path, SFM_WRITE, format, chans,
-                                                       in_handle->samplerate() );
+    if ( is_stdio_path( path ) ) {
+        format = stdout_format( format, chans, in_handle->samplerate() );
+    }
+
+    std::optional<SndfileHandle> out_handle( std::in_place, path, SFM_WRITE, format, chans,
+                                             in_handle->samplerate() );
     if ( out_handle->error() != SF_ERR_NO_ERROR ) {
         std::cout << "Could not open write file: " << path << std::endl;
         return {};
@@ -82,18 +153,64 @@ std::unique_ptr<SndfileHandle> make_output_handle( const std::string & path,
     return out_handle;
 }
 
-template <class F>
+// Open a sound_stream, e.g. a memory_stream, instead of a file. The stream must outlive the handle.
+inline std::optional<SndfileHandle> make_input_handle( sound_stream & stream ) noexcept {
+    std::optional<SndfileHandle> handle( std::in_place, sound_stream::callbacks(), &stream,
+                                         SFM_READ );
+    if ( handle->error() != SF_ERR_NO_ERROR ) {
+        std::cout << "Could not open read stream: " << handle->strError() << std::endl;
+        return {};
+    }
+
+    return handle;
+}
+
+inline std::optional<SndfileHandle>
+make_output_handle( sound_stream & stream,
+                    const std::optional<SndfileHandle> & in_handle,
+                    int format = SF_INPUT_FORMAT,
+                    int chans = SF_INPUT_CHANNELS ) noexcept {
+    if ( !in_handle ) {
+        return {};
+    }
+
+    if ( format == SF_INPUT_FORMAT ) {
+        format = in_handle->format();
+    }
+
+    if ( chans == SF_INPUT_CHANNELS ) {
+        chans = in_handle->channels();
+    }
+
+    std::optional<SndfileHandle> out_handle( std::in_place, sound_stream::callbacks(), &stream,
+                                             SFM_WRITE, format, chans, in_handle->samplerate() );
+    if ( out_handle->error() != SF_ERR_NO_ERROR ) {
+        std::cout << "Could not open write stream: " << out_handle->strError() << std::endl;
+        return {};
+    }
+
+    return out_handle;
+}
+
+// Reads `from` in blocks of up to `bufsize` frames, calls transform_func on each and writes it to
+// `to`. If `to` has more channels than `from`, the block's buffer has room for them, and
+// transform_func must widen the frames it is given in place (e.g. pan_mono_in_place). Blocks are
+// spans of Sample: short, int, float or double, as libsndfile reads them (see
+// dispatch_sample_format).
+template <class Sample = float, class F>
 bool transform_copy( SndfileHandle & from,
                      SndfileHandle & to,
                      F && transform_func,
                      const size_t bufsize = 1024 ) noexcept {
-    std::vector<float> floats( from.channels() * bufsize );
+    const int widest = std::max( from.channels(), to.channels() );
+    auto buffer = buffer_arena::shared().borrow_as<Sample>( widest * bufsize );
+    Sample * samples = buffer.template data_as<Sample>();
 
     sf_count_t read = 0;
     sf_count_t total_written = 0;
-    while ( ( read = from.readf( floats.data(), bufsize ) ) ) {
-        transform_func( std::span<float>{ floats.data(), size_t( read * from.channels() ) } );
-        auto written = to.writef( floats.data(), read );
+    while ( ( read = from.readf( samples, bufsize ) ) ) {
+        transform_func( std::span<Sample>{ samples, size_t( read * from.channels() ) } );
+        auto written = to.writef( samples, read );
         if ( written < read ) {
             std::cout << "Error while writing (" << written << " written): " << to.strError()
                       << std::endl;
@@ -103,18 +220,727 @@ bool transform_copy( SndfileHandle & from,
         total_written += written;
     }
 
-    if ( total_written != from.frames() ) {
-        std::cout << "Could not read entire file: " << from.strError() << std::endl;
-        std::cout << "Read " << from.frames() << " | Wrote " << to.frames() << std::endl;
-        return false;
+    return check_read_all( from, total_written );
+}
+
+// Like transform_copy, but reading, transforming and writing each run on their own thread so that
+// disk access and encoding overlap with the transform. `depth` buffers circulate between the
+// stages; the transform still sees every block once, in order. Blocks can be widened, and be of
+// any Sample type, as with transform_copy. Past starting the threads and sizing the queues, this
+// doesn't allocate: the blocks are borrowed from the arena and passed around by index.
+template <class Sample = float, class F>
+bool transform_copy_pipelined( SndfileHandle & from,
+                               SndfileHandle & to,
+                               F && transform_func,
+                               const size_t bufsize = 1024,
+                               const size_t depth = 4 ) noexcept {
+    const int channels = from.channels();
+    const size_t block_samples = std::max( channels, to.channels() ) * bufsize;
+
+    // All the blocks' samples back to back, and how many frames each one holds
+    auto buffer = buffer_arena::shared().borrow_as<Sample>( depth * block_samples );
+    auto counts = buffer_arena::shared().borrow_as<sf_count_t>( depth );
+    Sample * const samples = buffer.template data_as<Sample>();
+    sf_count_t * const frames = counts.template data_as<sf_count_t>();
+    auto block = [&]( size_t b ) { return samples + b * block_samples; };
+
+    // Each queue has room for every block, so they never grow
+    work_queue<size_t> empty( depth ), filled( depth ), transformed( depth );
+    for ( size_t b = 0; b < depth; ++b )
+        empty.push( b );
+
+    std::thread reader = helper_thread( [&] {
+        while ( auto b = empty.pop() ) {
+            frames[*b] = from.readf( block( *b ), bufsize );
+            if ( frames[*b] == 0 )
+                break;
+            filled.push( *b );
+        }
+        filled.close();
+    } );
+
+    std::thread transformer = helper_thread( [&] {
+        while ( auto b = filled.pop() ) {
+            transform_func( std::span<Sample>{ block( *b ), size_t( frames[*b] * channels ) } );
+            transformed.push( *b );
+        }
+        transformed.close();
+    } );
+
+    bool ok = true;
+    sf_count_t total_written = 0;
+    while ( auto b = transformed.pop() ) {
+        auto written = to.writef( block( *b ), frames[*b] );
+        if ( written < frames[*b] ) {
+            std::cout << "Error while writing (" << written << " written): " << to.strError()
+                      << std::endl;
+            ok = false;
+            break;
+        }
+
+        total_written += written;
+        empty.push( *b );
     }
 
-    return true;
+    // Stops the reader if writing failed; the other stages then drain on their own
+    empty.close();
+    reader.join();
+    transformer.join();
+
+    return ok && check_read_all( from, total_written );
 }
 
-bool scale_copy( SndfileHandle & from, SndfileHandle & to, Amplitude scale ) noexcept {
-    return transform_copy( from, to, [scale]( std::span<float> data ) {
-        std::transform( data.begin(), data.end(), data.begin(),
-                        [scale]( auto x ) { return x * scale; } );
+// Runs copy_func() and prints how fast it got through `passes` passes over the frames of `from`,
+// which it copies as Sample. Only the time is known for a stream without a length.
+template <class Sample = float, class F>
+bool report_throughput( SndfileHandle & from, F && copy_func, const size_t passes = 1 ) {
+    const auto start = std::chrono::steady_clock::now();
+    const bool result = copy_func();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if ( !is_seekable( from ) ) {
+        std::cout << "Processed stream in " << elapsed.count() << " s" << std::endl;
+        return result;
+    }
+
+    const double frames = double( from.frames() ) * passes;
+    const double megabytes = frames * from.channels() * sizeof( Sample ) / 1e6;
+    std::cout << "Processed " << frames << " frames in " << elapsed.count() << " s ("
+              << frames / elapsed.count() << " frames/s, " << megabytes / elapsed.count()
+              << " MB/s as " << sample_type_name<Sample>() << ")" << std::endl;
+    return result;
+}
+
+// Splits the frames of `from_path` into chunks and processes them on `threads` workers, each of
+// which reads its chunks through its own handle. make_transform() is called once per worker and
+// must return a callable f(data, first_frame), where `first_frame` is the index of the first frame
+// in `data`. Chunks are written to `to` in order on the calling thread, so the output is the same
+// as transform_copy's as long as f doesn't depend on how the frames are split up. Chunks are spans
+// of Sample, as with transform_copy.
+template <class Sample = float, class MakeTransform>
+bool transform_copy_parallel( const std::string & from_path,
+                              const SndfileHandle & from,
+                              SndfileHandle & to,
+                              MakeTransform && make_transform,
+                              const unsigned threads,
+                              const size_t chunk_frames = 65536 ) noexcept {
+    const int channels = from.channels();
+    if ( is_stdio_path( from_path ) ) {
+        // stdin can't be reopened by each worker, so it's read through `from` on this thread
+        SndfileHandle in = from;
+        auto transform = make_transform();
+        sf_count_t first_frame = 0;
+        auto apply = [&]( std::span<Sample> data ) {
+            transform( data, first_frame );
+            first_frame += data.size() / channels;
+        };
+        return transform_copy<Sample>( in, to, apply, chunk_frames );
+    }
+
+    const sf_count_t total_frames = from.frames();
+    const size_t num_chunks = ( total_frames + chunk_frames - 1 ) / chunk_frames;
+
+    // Workers can only get this many chunks ahead of the writer, which bounds memory use. The
+    // slots' samples are back to back in one buffer; each slot's frame count is -1 until a worker
+    // has filled it.
+    const size_t slots = 2 * threads;
+    const size_t slot_samples = chunk_frames * channels;
+    auto buffer = buffer_arena::shared().borrow_as<Sample>( slots * slot_samples );
+    auto counts = buffer_arena::shared().borrow_as<sf_count_t>( slots );
+    sf_count_t * const frames = counts.template data_as<sf_count_t>();
+    std::fill_n( frames, slots, sf_count_t( -1 ) );
+    Sample * const samples = buffer.template data_as<Sample>();
+    auto slot_data = [&]( size_t slot ) { return samples + slot * slot_samples; };
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t next_chunk = 0;
+    size_t chunks_written = 0;
+    bool abort = false;
+
+    auto work = [&] {
+        SndfileHandle in( from_path, SFM_READ );
+        if ( in.error() != SF_ERR_NO_ERROR )
+            std::cout << "Could not open read file: " << from_path << std::endl;
+        auto transform = make_transform();
+
+        for ( ;; ) {
+            std::unique_lock lock( mutex );
+            const size_t index = next_chunk++;
+            if ( index >= num_chunks )
+                return;
+            changed.wait( lock, [&] { return abort || index < chunks_written + slots; } );
+            if ( abort )
+                return;
+            lock.unlock();
+
+            const size_t slot = index % slots;
+            const sf_count_t first_frame = index * chunk_frames;
+            sf_count_t read = 0;
+            if ( in.error() == SF_ERR_NO_ERROR && in.seek( first_frame, SEEK_SET ) == first_frame )
+                read = in.readf( slot_data( slot ), chunk_frames );
+            transform( std::span<Sample>{ slot_data( slot ), size_t( read * channels ) },
+                       first_frame );
+
+            lock.lock();
+            frames[slot] = read;
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for ( unsigned i = 0; i < threads; ++i )
+        workers.push_back( helper_thread( work ) );
+
+    bool ok = true;
+    for ( size_t index = 0; index < num_chunks; ++index ) {
+        const size_t slot = index % slots;
+        sf_count_t read;
+        {
+            std::unique_lock lock( mutex );
+            changed.wait( lock, [&] { return frames[slot] != -1; } );
+            read = frames[slot];
+        }
+
+        const sf_count_t expected
+            = std::min<sf_count_t>( chunk_frames, total_frames - index * chunk_frames );
+        if ( read != expected ) {
+            std::cout << "Could not read entire file: " << from_path << std::endl;
+            ok = false;
+            break;
+        }
+
+        auto written = to.writef( slot_data( slot ), read );
+        if ( written < read ) {
+            std::cout << "Error while writing (" << written << " written): " << to.strError()
+                      << std::endl;
+            ok = false;
+            break;
+        }
+
+        std::lock_guard lock( mutex );
+        frames[slot] = -1;
+        ++chunks_written;
+        changed.notify_all();
+    }
+
+    {
+        std::lock_guard lock( mutex );
+        abort = true;
+    }
+    changed.notify_all();
+    for ( auto & worker : workers )
+        worker.join();
+
+    return ok;
+}
+
+// Transform that multiplies every sample by `scale`, for blocks of any sample type
+inline auto scale_by( Amplitude scale ) noexcept {
+    return [scale]( auto data ) { audio_kernels::apply_gain( data, scale ); };
+}
+
+// Calls transform_copy with the cheapest sample type for the two files' formats
+template <class F>
+bool transform_copy_native( SndfileHandle & from,
+                            SndfileHandle & to,
+                            F && transform_func,
+                            const size_t bufsize = 1024 ) noexcept {
+    return dispatch_sample_format( from.format(), to.format(), [&]( auto type ) {
+        using Sample = typename decltype( type )::type;
+        return transform_copy<Sample>( from, to, transform_func, bufsize );
     } );
 }
+
+inline bool scale_copy( SndfileHandle & from, SndfileHandle & to, Amplitude scale ) noexcept {
+    return transform_copy_native( from, to, scale_by( scale ) );
+}
+
+// Memory-mapped input
+//
+// For uncompressed files, the samples can be read straight out of a mapping of the file instead of
+// being copied through libsndfile's buffers.
+
+// Where the samples of an uncompressed file start, and how they are encoded.
+struct pcm_layout {
+    size_t offset; // in bytes
+    int subtype;   // SF_FORMAT_PCM_16, SF_FORMAT_PCM_24, SF_FORMAT_PCM_32 or SF_FORMAT_FLOAT
+    bool big_endian;
+};
+
+// Finds the sample data of a WAV, AIFF or RAW file with `format` (as reported by libsndfile).
+// Returns nothing for other containers and sample types, which need libsndfile to decode.
+inline std::optional<pcm_layout> find_pcm_layout( std::span<const std::byte> file,
+                                                  int format ) noexcept {
+    const int subtype = format & SF_FORMAT_SUBMASK;
+    if ( subtype != SF_FORMAT_PCM_16 && subtype != SF_FORMAT_PCM_24 && subtype != SF_FORMAT_PCM_32
+         && subtype != SF_FORMAT_FLOAT )
+        return std::nullopt;
+
+    auto tag_is = [file]( size_t pos, const char * tag ) {
+        return pos + 4 <= file.size() && std::memcmp( file.data() + pos, tag, 4 ) == 0;
+    };
+    auto size_at = [file]( size_t pos, bool big_endian ) {
+        size_t result = 0;
+        for ( size_t i = 0; i < 4; ++i ) {
+            auto byte = size_t( file[pos + ( big_endian ? i : 3 - i )] );
+            result = ( result << 8 ) | byte;
+        }
+        return result;
+    };
+
+    switch ( format & SF_FORMAT_TYPEMASK ) {
+    case SF_FORMAT_RAW: {
+        const int endian = format & SF_FORMAT_ENDMASK;
+        const bool native_big = std::endian::native == std::endian::big;
+        const bool big_endian
+            = endian == SF_ENDIAN_BIG || ( endian != SF_ENDIAN_LITTLE && native_big );
+        return pcm_layout{ 0, subtype, big_endian };
+    }
+    case SF_FORMAT_WAV:
+    case SF_FORMAT_WAVEX:
+        if ( !tag_is( 0, "RIFF" ) || !tag_is( 8, "WAVE" ) )
+            return std::nullopt;
+        for ( size_t pos = 12; pos + 8 <= file.size(); ) {
+            const size_t size = size_at( pos + 4, false );
+            if ( tag_is( pos, "data" ) )
+                return pcm_layout{ pos + 8, subtype, false };
+            pos += 8 + size + ( size & 1 ); // chunks are padded to an even size
+        }
+        return std::nullopt;
+    case SF_FORMAT_AIFF:
+        // AIFC may be compressed or little-endian; leave it to libsndfile
+        if ( !tag_is( 0, "FORM" ) || !tag_is( 8, "AIFF" ) )
+            return std::nullopt;
+        for ( size_t pos = 12; pos + 16 <= file.size(); ) {
+            const size_t size = size_at( pos + 4, true );
+            if ( tag_is( pos, "SSND" ) )
+                return pcm_layout{ pos + 16 + size_at( pos + 8, true ), subtype, true };
+            pos += 8 + size + ( size & 1 );
+        }
+        return std::nullopt;
+    default:
+        return std::nullopt;
+    }
+}
+
+// Reads interleaved float frames out of a memory mapping of an uncompressed sound file. Integer
+// samples are scaled the same way libsndfile scales them when reading floats.
+class mapped_pcm_reader {
+public:
+    // Returns nothing if the file can't be mapped or needs libsndfile to decode it.
+    static std::optional<mapped_pcm_reader> open( const std::string & path,
+                                                  const SndfileHandle & handle ) noexcept {
+        if ( is_stdio_path( path ) )
+            return std::nullopt;
+
+        mapped_file file( path );
+        if ( !file )
+            return std::nullopt;
+
+        auto layout = find_pcm_layout( file.bytes(), handle.format() );
+        if ( !layout )
+            return std::nullopt;
+
+        // Make sure libsndfile's idea of the length fits in the mapping
+        const size_t sample_size = layout->subtype == SF_FORMAT_PCM_16
+            ? 2
+            : layout->subtype == SF_FORMAT_PCM_24 ? 3 : 4;
+        const size_t data_size = size_t( handle.frames() ) * handle.channels() * sample_size;
+        if ( layout->offset + data_size > file.bytes().size() )
+            return std::nullopt;
+
+        file.advise_sequential();
+        return mapped_pcm_reader( std::move( file ), *layout, sample_size, handle.frames(),
+                                  handle.channels() );
+    }
+
+    sf_count_t frames() const noexcept {
+        return _frames;
+    }
+
+    int channels() const noexcept {
+        return _channels;
+    }
+
+    // Returns frames [start, start + n), clipped to the end of the file. Native-endian, aligned
+    // float data is returned in place; anything else is converted into `scratch`, which must have
+    // room for n frames.
+    std::span<const float> read( sf_count_t start, sf_count_t n, std::span<float> scratch ) const
+        noexcept {
+        n = std::clamp<sf_count_t>( _frames - start, 0, n );
+        const size_t count = size_t( n ) * _channels;
+        const std::byte * src
+            = _file.bytes().data() + _layout.offset + size_t( start ) * _channels * _sample_size;
+
+        const bool native = _layout.big_endian == ( std::endian::native == std::endian::big );
+        if ( _layout.subtype == SF_FORMAT_FLOAT && native
+             && reinterpret_cast<uintptr_t>( src ) % alignof( float ) == 0 )
+            return { reinterpret_cast<const float *>( src ), count };
+
+        for ( size_t i = 0; i < count; ++i )
+            scratch[i] = sample_at( src + i * _sample_size );
+        return scratch.first( count );
+    }
+
+private:
+    mapped_pcm_reader( mapped_file file,
+                       pcm_layout layout,
+                       size_t sample_size,
+                       sf_count_t frames,
+                       int channels ) noexcept:
+        _file( std::move( file ) ),
+        _layout( layout ),
+        _sample_size( sample_size ),
+        _frames( frames ),
+        _channels( channels ) {
+    }
+
+    // Assembles the sample's bytes most significant first
+    uint32_t bits_at( const std::byte * p ) const noexcept {
+        uint32_t result = 0;
+        for ( size_t i = 0; i < _sample_size; ++i ) {
+            auto byte = uint32_t( p[_layout.big_endian ? i : _sample_size - 1 - i] );
+            result = ( result << 8 ) | byte;
+        }
+        return result;
+    }
+
+    float sample_at( const std::byte * p ) const noexcept {
+        const uint32_t bits = bits_at( p );
+        switch ( _layout.subtype ) {
+        case SF_FORMAT_PCM_16:
+            return float( int16_t( bits ) ) * ( 1.f / 0x8000 );
+        case SF_FORMAT_PCM_24:
+            return float( int32_t( bits << 8 ) >> 8 ) * ( 1.f / 0x800000 );
+        case SF_FORMAT_PCM_32:
+            return float( int32_t( bits ) ) * ( 1.f / 0x80000000 );
+        default:
+            return std::bit_cast<float>( bits );
+        }
+    }
+
+    mapped_file _file;
+    pcm_layout _layout;
+    size_t _sample_size;
+    sf_count_t _frames;
+    int _channels;
+};
+
+// Like transform_copy, but the transform is called as f(in, out) with the input and output blocks
+// passed separately. If `from_path` is an uncompressed file, `in` comes straight from a memory
+// mapping of it and libsndfile is only used for writing; otherwise this falls back to reading
+// through `from`. `in` and `out` may refer to the same memory.
+template <class F>
+bool transform_copy_mapped( const std::string & from_path,
+                            SndfileHandle & from,
+                            SndfileHandle & to,
+                            F && transform_func,
+                            const size_t bufsize = 1024 ) noexcept {
+    auto reader = mapped_pcm_reader::open( from_path, from );
+    if ( !reader ) {
+        return transform_copy(
+            from, to,
+            [&transform_func]( std::span<float> data ) {
+                transform_func( std::span<const float>( data ), data );
+            },
+            bufsize );
+    }
+
+    // Doubles as the conversion buffer for inputs that can't be used in place
+    auto floats = buffer_arena::shared().borrow( reader->channels() * bufsize );
+
+    sf_count_t total_written = 0;
+    while ( total_written < reader->frames() ) {
+        auto in = reader->read( total_written, bufsize, floats.samples() );
+        const sf_count_t frames = in.size() / reader->channels();
+        if ( frames == 0 )
+            break;
+        transform_func( in, std::span<float>{ floats.data(), in.size() } );
+        auto written = to.writef( floats.data(), frames );
+        if ( written < frames ) {
+            std::cout << "Error while writing (" << written << " written): " << to.strError()
+                      << std::endl;
+            return false;
+        }
+
+        total_written += written;
+    }
+
+    // `from` itself isn't read from, so this only compares the count with its length
+    return check_read_all( from, total_written );
+}
+
+inline bool scale_copy( const std::string & from_path,
+                        SndfileHandle & from,
+                        SndfileHandle & to,
+                        Amplitude scale ) noexcept {
+    // Only float samples can come straight out of a mapping; the rest keep their own type
+    if ( choose_sample_format( from.format(), to.format() ) != sample_format::float32 )
+        return scale_copy( from, to, scale );
+
+    return transform_copy_mapped(
+        from_path, from, to, [scale]( std::span<const float> in, std::span<float> out ) {
+            std::transform( in.begin(), in.end(), out.begin(),
+                            [scale]( auto x ) { return x * scale; } );
+        } );
+}
+
+// Peak scanning
+
+// Asks libsndfile to write a PEAK chunk into `handle`, which must be open for writing and not
+// written to yet. libsndfile works out the peak itself as the data goes by. Returns false if the
+// container or sample type can't carry one (only float WAV and AIFF can).
+inline bool add_peak_chunk( SndfileHandle & handle ) noexcept {
+    return handle.command( SFC_SET_ADD_PEAK_CHUNK, nullptr, SF_TRUE ) == SF_TRUE;
+}
+
+// Builds signal_stats from blocks of interleaved samples as they go by, e.g. while writing.
+class signal_meter {
+public:
+    explicit signal_meter( int channels ): _peaks( channels, 0.f ), _sum_squares( channels, 0.0 ) {
+    }
+
+    void add( std::span<const float> block ) noexcept {
+        audio_kernels::accumulate_peaks( block, _peaks );
+        audio_kernels::accumulate_squares( block, _sum_squares );
+        _frames += block.size() / _peaks.size();
+    }
+
+    signal_stats stats() const {
+        signal_stats result{ _frames, _peaks, {} };
+        for ( auto sum : _sum_squares )
+            result.rms.push_back( _frames ? std::sqrt( sum / _frames ) : 0.0 );
+        return result;
+    }
+
+private:
+    std::vector<Amplitude> _peaks;
+    std::vector<double> _sum_squares;
+    int64_t _frames = 0;
+};
+
+// Reads `from` in chunks of `chunk_frames` frames, one after another on the calling thread, and
+// calls f(block, first_frame) on each. For handles that have no path to reopen, such as those on a
+// sound_stream or stdin. Returns false (after a message) if the file couldn't be read in full.
+template <class F>
+bool scan_chunks( SndfileHandle & from, F && f, const size_t chunk_frames = 65536 ) noexcept {
+    const int channels = from.channels();
+    auto floats = buffer_arena::shared().borrow( chunk_frames * channels );
+
+    sf_count_t total_read = 0;
+    sf_count_t read = 0;
+    while ( ( read = from.readf( floats.data(), chunk_frames ) ) ) {
+        f( std::span<const float>{ floats.data(), size_t( read * channels ) }, total_read );
+        total_read += read;
+    }
+
+    return check_read_all( from, total_read );
+}
+
+// Reads the file at `path` in chunks of `chunk_frames` frames and calls f(block, first_frame) on
+// each, where `first_frame` is the index of the first frame in the interleaved `block`. `handle`
+// must be open on the same file and is only used for its properties. Uncompressed files are read
+// straight out of a memory mapping; anything else is read through libsndfile. With `threads` > 1,
+// chunks are read on that many workers and f is called concurrently, in no particular order. stdin
+// is read through `handle` as by the overload above. Returns false (after a message) if the file
+// couldn't be read in full.
+template <class F>
+bool scan_chunks( const std::string & path,
+                  const SndfileHandle & handle,
+                  F && f,
+                  const unsigned threads = 1,
+                  const size_t chunk_frames = 65536 ) noexcept {
+    if ( is_stdio_path( path ) ) {
+        // stdin can't be reopened, so it is read through `handle` itself, in order
+        SndfileHandle in = handle;
+        return scan_chunks( in, std::forward<F>( f ), chunk_frames );
+    }
+
+    const int channels = handle.channels();
+    const sf_count_t total_frames = handle.frames();
+    const size_t num_chunks = ( total_frames + chunk_frames - 1 ) / chunk_frames;
+    const auto reader = mapped_pcm_reader::open( path, handle );
+
+    // Every worker's buffer is borrowed here, back to back, rather than by the workers as they
+    // start, so how many buffers are out at once doesn't depend on how the threads are scheduled
+    const unsigned workers_count = std::max( threads, 1u );
+    const size_t chunk_samples = chunk_frames * channels;
+    auto buffer = buffer_arena::shared().borrow( workers_count * chunk_samples );
+
+    std::mutex mutex;
+    size_t next_chunk = 0;
+    bool failed = false;
+
+    auto work = [&]( const unsigned worker ) {
+        SndfileHandle in;
+        if ( !reader )
+            in = SndfileHandle( path, SFM_READ );
+
+        const std::span<float> floats( buffer.data() + worker * chunk_samples, chunk_samples );
+        bool ok = reader || in.error() == SF_ERR_NO_ERROR;
+        while ( ok ) {
+            size_t index;
+            {
+                std::lock_guard lock( mutex );
+                index = next_chunk++;
+            }
+            if ( index >= num_chunks )
+                break;
+
+            const sf_count_t first_frame = index * chunk_frames;
+            const sf_count_t expected
+                = std::min<sf_count_t>( chunk_frames, total_frames - first_frame );
+            std::span<const float> block;
+            if ( reader ) {
+                block = reader->read( first_frame, expected, floats );
+            } else if ( in.seek( first_frame, SEEK_SET ) == first_frame ) {
+                block = { floats.data(), size_t( in.readf( floats.data(), expected ) * channels ) };
+            }
+
+            ok = block.size() == size_t( expected * channels );
+            if ( ok )
+                f( block, first_frame );
+        }
+
+        std::lock_guard lock( mutex );
+        failed = failed || !ok;
+    };
+
+    if ( threads > 1 ) {
+        std::vector<std::thread> workers;
+        for ( unsigned i = 0; i < threads; ++i )
+            workers.push_back( helper_thread( work, i ) );
+        for ( auto & worker : workers )
+            worker.join();
+    } else {
+        work( 0 );
+    }
+
+    if ( failed ) {
+        std::cout << "Could not read entire file: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Largest absolute sample value in each channel of the file at `path`, and with `with_rms` also
+// each channel's RMS, or nothing if the file couldn't be read in full. Read as by scan_chunks.
+inline std::optional<signal_stats> scan_signal( const std::string & path,
+                                                const SndfileHandle & handle,
+                                                const unsigned threads = 1,
+                                                const bool with_rms = false,
+                                                const size_t chunk_frames = 65536 ) noexcept {
+    const int channels = handle.channels();
+    sf_count_t total_frames = 0; // counted, since a stream doesn't know its length
+
+    // Only the stats returned are allocated; the sums and the scratch are borrowed up front. Each
+    // chunk being measured takes one of `slots` scratch slots, so borrowing doesn't depend on how
+    // the chunks happen to overlap.
+    std::vector<Amplitude> peaks( channels, 0.f );
+    const size_t slots = std::max( threads, 1u );
+    auto sums = buffer_arena::shared().borrow_as<double>( channels * ( slots + 1 ) );
+    auto peaks_scratch = buffer_arena::shared().borrow( channels * slots );
+    auto free_scratch = buffer_arena::shared().borrow_as<size_t>( slots );
+    const std::span<double> sum_squares( sums.data_as<double>(), channels );
+    std::fill( sum_squares.begin(), sum_squares.end(), 0.0 );
+    size_t * const free_slots = free_scratch.data_as<size_t>();
+    size_t free_count = slots;
+    for ( size_t i = 0; i < slots; ++i )
+        free_slots[i] = i;
+    std::mutex mutex;
+
+    auto measure = [&]( std::span<const float> block, sf_count_t ) {
+        size_t slot;
+        {
+            std::lock_guard lock( mutex );
+            slot = free_slots[--free_count];
+        }
+
+        const std::span<Amplitude> local( peaks_scratch.data() + slot * channels, channels );
+        const std::span<double> local_squares( sums.data_as<double>() + ( slot + 1 ) * channels,
+                                               channels );
+        std::fill( local.begin(), local.end(), 0.f );
+        std::fill( local_squares.begin(), local_squares.end(), 0.0 );
+        audio_kernels::accumulate_peaks( block, local );
+        if ( with_rms )
+            audio_kernels::accumulate_squares( block, local_squares );
+
+        std::lock_guard lock( mutex );
+        total_frames += block.size() / channels;
+        for ( int c = 0; c < channels; ++c ) {
+            peaks[c] = std::max( peaks[c], local[c] );
+            sum_squares[c] += local_squares[c];
+        }
+        free_slots[free_count++] = slot;
+    };
+
+    if ( !scan_chunks( path, handle, measure, threads, chunk_frames ) )
+        return std::nullopt;
+
+    signal_stats stats{ total_frames, std::move( peaks ), {} };
+    if ( with_rms ) {
+        stats.rms.reserve( channels );
+        for ( auto sum : sum_squares )
+            stats.rms.push_back( total_frames ? std::sqrt( sum / total_frames ) : 0.0 );
+    }
+    return stats;
+}
+
+// Like scan_signal, but consults `cache` first and stores what it scans there. Entries always
+// include RMS. Without a cache this is a plain peak scan.
+inline std::optional<signal_stats> cached_scan_signal( const std::string & path,
+                                                       const SndfileHandle & handle,
+                                                       peak_cache * cache,
+                                                       const unsigned threads = 1 ) noexcept {
+    if ( !cache || is_stdio_path( path ) )
+        return scan_signal( path, handle, threads );
+
+    auto cached = cache->lookup( path );
+    if ( cached && cached->frames == handle.frames()
+         && cached->peaks.size() == size_t( handle.channels() ) )
+        return cached;
+
+    auto stats = scan_signal( path, handle, threads, true );
+    if ( stats )
+        cache->store( path, *stats );
+    return stats;
+}
+
+// Largest absolute sample value in each channel; see scan_signal.
+inline std::optional<std::vector<Amplitude>>
+scan_channel_peaks( const std::string & path,
+                    const SndfileHandle & handle,
+                    const unsigned threads = 1,
+                    peak_cache * cache = nullptr ) noexcept {
+    auto stats = cached_scan_signal( path, handle, cache, threads );
+    if ( !stats )
+        return std::nullopt;
+    return std::move( stats->peaks );
+}
+
+// Largest absolute sample value over all channels; see scan_signal.
+inline std::optional<Amplitude> scan_peak( const std::string & path,
+                                           const SndfileHandle & handle,
+                                           const unsigned threads = 1,
+                                           peak_cache * cache = nullptr ) noexcept {
+    auto stats = cached_scan_signal( path, handle, cache, threads );
+    if ( !stats )
+        return std::nullopt;
+    return stats->peak();
+}
+
+// Peak from the file's PEAK chunk if it has one, otherwise scanned with scan_peak. Prints a
+// message if neither works.
+inline std::optional<double> find_peak( const std::string & path,
+                                        SndfileHandle & handle,
+                                        const unsigned threads = 1,
+                                        peak_cache * cache = nullptr ) noexcept {
+    double peak;
+    if ( handle.command( SFC_GET_SIGNAL_MAX, &peak, sizeof( peak ) ) )
+        return peak;
+    if ( auto scanned = scan_peak( path, handle, threads, cache ) )
+        return *scanned;
+    std::cout << "Could not calc peak" << std::endl;
+    return std::nullopt;
+}
@@ -11,21 +11,42 @@ class stereo_envelope_generator : public envelop_generator_base<stereo_envelope_
 public:
     // Points: breakpoint envelope. Assumed to start from time 0. No assumption made about last
     // time. Sample rate: used for conversion from seconds to samples. Bufsize: max number of frames
-    // that will be requested at one time.
-    stereo_envelope_generator( const breakpoint::point_list & points,
+    // that will be requested at one time. Pan law: table used to turn positions into gains; the
+    // generator keeps its own copy.
+    stereo_envelope_generator( std::span<const breakpoint::point> points,
                                const uint32_t sample_rate,
-                               const size_t bufsize ):
-        Base( points, sample_rate, bufsize, audio_math::root_two_div_two() )
+                               const size_t bufsize,
+                               pan_law_table pan_law = pan_law_table::standard() ):
+        Base( points, sample_rate, bufsize, audio_math::root_two_div_two() ),
+        _pan_law( std::move( pan_law ) ),
+        _positions( bufsize )
+    {}
+
+    stereo_envelope_generator( std::initializer_list<breakpoint::point> points,
+                               const uint32_t sample_rate,
+                               const size_t bufsize,
+                               pan_law_table pan_law = pan_law_table::standard() ):
+        stereo_envelope_generator( std::span( points.begin(), points.size() ), sample_rate,
+                                   bufsize, std::move( pan_law ) )
+    {}
+
+    // Reads the points off `points` as they are needed; see envelop_generator_base.
+    stereo_envelope_generator( breakpoint::point_stream points,
+                               const uint32_t sample_rate,
+                               const size_t bufsize,
+                               pan_law_table pan_law = pan_law_table::standard() ):
+        Base( std::move( points ), sample_rate, bufsize, audio_math::root_two_div_two() ),
+        _pan_law( std::move( pan_law ) ),
+        _positions( bufsize )
     {}
 
 private:
     friend Base;
     void generate_frames( std::vector<float>& buffer, const size_t index, const size_t n ) noexcept {
-        for ( size_t i = 0; i < n; ++i ) {
-            auto val = val_at( index + i );
-            auto pan = constant_power_pan<float>( val );
-            buffer[i * 2] = pan.left;
-            buffer[i * 2 + 1] = pan.right;
-        }
+        render_values( _positions.data(), index, n );
+        _pan_law.pan( { _positions.data(), n }, { buffer.data(), n * 2 } );
     }
+
+    pan_law_table _pan_law;
+    std::vector<float> _positions;
 };
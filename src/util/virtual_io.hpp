@@ -0,0 +1,179 @@
+// sound files in memory or behind callbacks, through libsndfile's virtual I/O
+#pragma once
+
+#include "sndfile.hh"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <span>
+#include <utility>
+#include <vector>
+
+// The bytes of a sound file, wherever they live. Implement this to have libsndfile read or write
+// through your own callbacks; memory_stream and memory_view cover buffers in RAM. A stream must
+// outlive any SndfileHandle opened on it.
+class sound_stream {
+public:
+    virtual ~sound_stream() = default;
+
+    // Size of the whole file in bytes
+    virtual sf_count_t length() = 0;
+
+    // As fseek; returns the new position, or -1 if it would be out of range
+    virtual sf_count_t seek( sf_count_t offset, int whence ) = 0;
+
+    // Return how many bytes were actually transferred
+    virtual sf_count_t read( void * ptr, sf_count_t count ) = 0;
+    virtual sf_count_t write( const void * ptr, sf_count_t count ) = 0;
+
+    virtual sf_count_t tell() = 0;
+
+    // The callbacks to pass to libsndfile along with a pointer to the stream. Exceptions can't
+    // unwind through libsndfile's C frames, so a call that throws returns what a failed one would.
+    static SF_VIRTUAL_IO & callbacks() noexcept {
+        static SF_VIRTUAL_IO io{
+            []( void * self ) noexcept {
+                return guarded( [&] { return stream( self ).length(); }, 0 );
+            },
+            []( sf_count_t offset, int whence, void * self ) noexcept {
+                return guarded( [&] { return stream( self ).seek( offset, whence ); }, -1 );
+            },
+            []( void * ptr, sf_count_t count, void * self ) noexcept {
+                return guarded( [&] { return stream( self ).read( ptr, count ); }, 0 );
+            },
+            []( const void * ptr, sf_count_t count, void * self ) noexcept {
+                return guarded( [&] { return stream( self ).write( ptr, count ); }, 0 );
+            },
+            []( void * self ) noexcept {
+                return guarded( [&] { return stream( self ).tell(); }, -1 );
+            },
+        };
+        return io;
+    }
+
+protected:
+    // Where seek( offset, whence ) lands from `position` in a file of `size` bytes, or -1
+    static sf_count_t seek_target( sf_count_t position,
+                                   sf_count_t size,
+                                   sf_count_t offset,
+                                   int whence ) noexcept {
+        const sf_count_t base = whence == SEEK_SET ? 0 : whence == SEEK_CUR ? position : size;
+        return base + offset < 0 ? -1 : base + offset;
+    }
+
+private:
+    static sound_stream & stream( void * self ) noexcept {
+        return *static_cast<sound_stream *>( self );
+    }
+
+    template <class F> static sf_count_t guarded( F && f, const sf_count_t failed ) noexcept {
+        try {
+            return f();
+        } catch ( ... ) {
+            return failed;
+        }
+    }
+};
+
+// A sound file read from and written to a growable buffer. Writing past the end extends it, with
+// zeros filling any gap, as a file would.
+class memory_stream : public sound_stream {
+public:
+    memory_stream() = default;
+
+    // Starts with the bytes of an existing file, e.g. to read it
+    explicit memory_stream( std::vector<std::byte> bytes ) noexcept: _bytes( std::move( bytes ) ) {
+    }
+
+    sf_count_t length() override {
+        return sf_count_t( _bytes.size() );
+    }
+
+    sf_count_t seek( sf_count_t offset, int whence ) override {
+        const sf_count_t target = seek_target( _position, length(), offset, whence );
+        if ( target >= 0 )
+            _position = target;
+        return target;
+    }
+
+    sf_count_t read( void * ptr, sf_count_t count ) override {
+        count = std::clamp<sf_count_t>( length() - _position, 0, count );
+        std::memcpy( ptr, _bytes.data() + _position, size_t( count ) );
+        _position += count;
+        return count;
+    }
+
+    // Writes nothing if the buffer can't grow to fit
+    sf_count_t write( const void * ptr, sf_count_t count ) override {
+        if ( _position + count > length() ) {
+            try {
+                _bytes.resize( size_t( _position + count ) );
+            } catch ( const std::bad_alloc & ) {
+                return 0;
+            }
+        }
+        std::memcpy( _bytes.data() + _position, ptr, size_t( count ) );
+        _position += count;
+        return count;
+    }
+
+    sf_count_t tell() override {
+        return _position;
+    }
+
+    // The file so far. Only complete once the handles writing it have been closed, since
+    // libsndfile fills in the header's sizes last.
+    std::span<const std::byte> bytes() const noexcept {
+        return _bytes;
+    }
+
+    // Hands over the buffer and leaves the stream empty
+    std::vector<std::byte> take() noexcept {
+        _position = 0;
+        return std::exchange( _bytes, {} );
+    }
+
+private:
+    std::vector<std::byte> _bytes;
+    sf_count_t _position = 0;
+};
+
+// Reads a sound file out of memory owned by someone else, without copying it. Writes fail.
+class memory_view : public sound_stream {
+public:
+    explicit memory_view( std::span<const std::byte> bytes ) noexcept: _bytes( bytes ) {
+    }
+
+    sf_count_t length() override {
+        return sf_count_t( _bytes.size() );
+    }
+
+    sf_count_t seek( sf_count_t offset, int whence ) override {
+        const sf_count_t target = seek_target( _position, length(), offset, whence );
+        if ( target >= 0 )
+            _position = target;
+        return target;
+    }
+
+    sf_count_t read( void * ptr, sf_count_t count ) override {
+        count = std::clamp<sf_count_t>( length() - _position, 0, count );
+        std::memcpy( ptr, _bytes.data() + _position, size_t( count ) );
+        _position += count;
+        return count;
+    }
+
+    sf_count_t write( const void *, sf_count_t ) override {
+        return 0;
+    }
+
+    sf_count_t tell() override {
+        return _position;
+    }
+
+private:
+    std::span<const std::byte> _bytes;
+    sf_count_t _position = 0;
+};
@@ -0,0 +1,68 @@
+// blocking queue for handing work between threads
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+// Items are kept in a ring that only grows when it is full, so a queue that never holds more than
+// `capacity` items doesn't allocate after it is constructed.
+template <typename T> class work_queue {
+public:
+    explicit work_queue( size_t capacity = 0 ): _items( capacity ) {
+    }
+
+    void push( T item ) {
+        {
+            std::lock_guard lock( _mutex );
+            if ( _count == _items.size() )
+                grow();
+            _items[( _head + _count ) % _items.size()] = std::move( item );
+            ++_count;
+        }
+        _ready.notify_one();
+    }
+
+    // Blocks until there is an item or the queue is closed. Items pushed before close() are still
+    // handed out; after that, returns nothing.
+    std::optional<T> pop() {
+        std::unique_lock lock( _mutex );
+        _ready.wait( lock, [this] { return _closed || _count != 0; } );
+        if ( _count == 0 )
+            return std::nullopt;
+
+        T item = std::move( _items[_head] );
+        _head = ( _head + 1 ) % _items.size();
+        --_count;
+        return item;
+    }
+
+    // Wakes everyone waiting in pop().
+    void close() {
+        {
+            std::lock_guard lock( _mutex );
+            _closed = true;
+        }
+        _ready.notify_all();
+    }
+
+private:
+    // Doubles the ring, with the oldest item moved to the front
+    void grow() {
+        std::vector<T> bigger( std::max<size_t>( 8, _items.size() * 2 ) );
+        for ( size_t i = 0; i < _count; ++i )
+            bigger[i] = std::move( _items[( _head + i ) % _items.size()] );
+        _items = std::move( bigger );
+        _head = 0;
+    }
+
+    std::mutex _mutex;
+    std::condition_variable _ready;
+    std::vector<T> _items;
+    size_t _head = 0;  // index of the oldest item
+    size_t _count = 0; // how many items are in the ring
+    bool _closed = false;
+};
@@ -1,9 +1,13 @@
 #define CATCH_CONFIG_MAIN
 #define CATCH_CONFIG_FAST_COMPILE
 #include "catch/catch.hpp"
+#include "temp_path.hpp"
 
 #include "breakpoint/breakpoint.hpp"
 
+#include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <ios>
 #include <sstream>
 
@@ -128,6 +132,25 @@ TEST_CASE( "failure first time not 0" ) {
     require_error( "1 1\n0 2\n", parse_error::first_time_not_zero, 1 );
 }
 
+TEST_CASE( "success number formats" ) {
+    require_success( "0 +1\n1e-3 -2.5E2\n0x1p1 .5\n", { { 0, 1 }, { 1e-3, -250 }, { 2, .5 } } );
+    require_success( "0 1e-400\n1 -1e400\n", { { 0, 0 }, { 1, -HUGE_VAL } } );
+}
+
+TEST_CASE( "failure number formats" ) {
+    require_error( "0 0\n1 1e400\n", parse_error::misformatted_line, 2 );
+    require_error( "0 0\n1 inf\n", parse_error::misformatted_line, 2 );
+    require_error( "0 0\n1 +-1\n", parse_error::misformatted_line, 2 );
+    require_error( "0 0\r\n1 1\r\n", parse_error::misformatted_line, 1 );
+}
+
+TEST_CASE( "failure reports line of later points" ) {
+    require_error( "0 0\n\n1 1\n\n  \n2 2\n1.5 3\n\n", parse_error::time_not_increasing, 6 );
+    require_error( "\n\n1 1\n2 2\n", parse_error::first_time_not_zero, 3 );
+    require_error( "0 0\n1 1\n\n2 2", parse_error::unexpected_eof, 4 );
+    require_error( "0 0\n\n1 1\n2 2\n3 X\n", parse_error::misformatted_line, 5 );
+}
+
 // ----------------------------------------------------------------------------------------------------
 // write_breakpoints
 // ----------------------------------------------------------------------------------------------------
@@ -167,3 +190,219 @@ TEST_CASE( "failure" ) {
     CHECK( !ok );
     CHECK( os.str() == "" );
 }
+
+// ----------------------------------------------------------------------------------------------------
+// simplify
+// ----------------------------------------------------------------------------------------------------
+
+// Value of the envelope through `points` at `time`
+static double value_at( const point_list & points, double time ) {
+    for ( size_t i = 1; i < points.size(); ++i ) {
+        if ( time <= points[i].time_secs ) {
+            auto & a = points[i - 1];
+            auto & b = points[i];
+            const double slope = ( b.value - a.value ) / ( b.time_secs - a.time_secs );
+            return a.value + slope * ( time - a.time_secs );
+        }
+    }
+    return points.back().value;
+}
+
+TEST_CASE( "simplify short lists unchanged" ) {
+    CHECK( simplify( point_list{}, 0.1 ).empty() );
+    CHECK( simplify( point_list{ { 0, 1 }, { 1, 5 } }, 10.0 ) == point_list{ { 0, 1 }, { 1, 5 } } );
+}
+
+TEST_CASE( "simplify drops points on a line" ) {
+    CHECK( simplify( point_list{ { 0, 0 }, { 1, 1 }, { 2, 2 }, { 3, 3 } }, 0.0 )
+           == point_list{ { 0, 0 }, { 3, 3 } } );
+    CHECK( simplify( point_list{ { 0, 0 }, { 1, 1 }, { 2, 0 } }, 0.0 )
+           == point_list{ { 0, 0 }, { 1, 1 }, { 2, 0 } } );
+    CHECK( simplify( point_list{ { 0, 0 }, { 1, 0.05 }, { 2, 0 } }, 0.1 )
+           == point_list{ { 0, 0 }, { 2, 0 } } );
+}
+
+TEST_CASE( "simplify drops a collinear run with zero tolerance" ) {
+    const point_list points{ { 0, 0 }, { 1, 2 }, { 2, 1.5 }, { 3, 1 }, { 4, 0.5 }, { 5, 3 } };
+    CHECK( simplify( points, 0.0 ) == point_list{ { 0, 0 }, { 1, 2 }, { 4, 0.5 }, { 5, 3 } } );
+}
+
+TEST_CASE( "simplify keeps every point with a negative tolerance" ) {
+    const point_list peak{ { 0, 0 }, { 1, 1 }, { 2, 0 } };
+    CHECK( simplify( peak, -0.5 ) == peak );
+    const point_list line{ { 0, 0 }, { 1, 1 }, { 2, 2 }, { 3, 3 } };
+    CHECK( simplify( line, -0.5 ) == line );
+}
+
+TEST_CASE( "simplify stays within tolerance" ) {
+    point_list points;
+    for ( int i = 0; i < 1000; ++i )
+        points.push_back( { i * 0.01, std::sin( i * 0.05 ) + 0.1 * std::sin( i * 1.3 ) } );
+
+    for ( double tolerance : { 0.0, 0.01, 0.1, 0.5 } ) {
+        auto simple = simplify( points, tolerance );
+        INFO( "tolerance=" << tolerance );
+        CHECK( simple.front() == points.front() );
+        CHECK( simple.back() == points.back() );
+        CHECK( simple.size() <= points.size() );
+        for ( auto & p : points )
+            CHECK( std::abs( value_at( simple, p.time_secs ) - p.value ) <= tolerance + 1e-12 );
+    }
+    CHECK( simplify( points, 0.5 ).size() < 100 );
+}
+
+// ----------------------------------------------------------------------------------------------------
+// binary format
+// ----------------------------------------------------------------------------------------------------
+
+// A breakpoint file in the temp directory, removed afterwards
+struct temp_file {
+    temp_file( const std::string & contents ):
+        path( temp_path( "breakpoint_test.bkpt" ) ) {
+        std::ofstream( path, std::ios::binary | std::ios::trunc ) << contents;
+    }
+
+    ~temp_file() {
+        std::filesystem::remove( path );
+    }
+
+    std::string path;
+};
+
+static std::string to_binary( const point_list & points,
+                              binary_precision precision = binary_precision::float64 ) {
+    std::ostringstream os;
+    REQUIRE( write_breakpoints_binary( os, points, precision ) );
+    return os.str();
+}
+
+static void require_read( const std::string & contents, const point_list & expected ) {
+    temp_file file( contents );
+    auto result = read_breakpoints( file.path );
+    auto * bkpts = std::get_if<breakpoint_file>( &result );
+    REQUIRE( bkpts );
+    CHECK( point_list( bkpts->points().begin(), bkpts->points().end() ) == expected );
+}
+
+static void require_read_error( const std::string & contents, parse_error::errc code,
+                                unsigned line ) {
+    temp_file file( contents );
+    auto result = read_breakpoints( file.path );
+    auto * error = std::get_if<parse_error>( &result );
+    REQUIRE( error );
+    CHECK( error->line == line );
+    CHECK( error->code == code );
+}
+
+static const point_list example{ { 0.0, -1.0 }, { 0.5, 0.25 }, { 1.5, 3.5 } };
+
+TEST_CASE( "binary header layout" ) {
+    auto bytes = to_binary( example );
+    REQUIRE( bytes.size() == 24 + 3 * 16 );
+    CHECK( bytes.substr( 0, 8 ) == "TAPBBKPT" );
+    CHECK( bytes.substr( 8, 8 ) == std::string( "\1\0\0\0\0\0\0\0", 8 ) );
+    CHECK( bytes.substr( 16, 8 ) == std::string( "\3\0\0\0\0\0\0\0", 8 ) );
+}
+
+TEST_CASE( "binary round trip" ) {
+    require_read( to_binary( example ), example );
+    require_read( to_binary( example, binary_precision::float32 ), example );
+}
+
+TEST_CASE( "text files still read" ) {
+    require_read( "0 -1\n0.5 0.25\n1.5 3.5\n", example );
+    require_read_error( "", parse_error::unexpected_eof, 1 );
+}
+
+TEST_CASE( "binary failure bad header" ) {
+    auto bytes = to_binary( example );
+    require_read_error( bytes.substr( 0, 20 ), parse_error::misformatted_line, 0 );
+    require_read_error( std::string( bytes ).replace( 8, 1, "\2" ), parse_error::misformatted_line,
+                        0 );
+    require_read_error( std::string( bytes ).replace( 12, 1, "\7" ), parse_error::misformatted_line,
+                        0 );
+}
+
+TEST_CASE( "binary failure truncated" ) {
+    auto bytes = to_binary( example );
+    require_read_error( bytes.substr( 0, bytes.size() - 1 ), parse_error::unexpected_eof, 3 );
+}
+
+TEST_CASE( "binary failure validation" ) {
+    require_read_error( to_binary( { { 0.0, 1.0 } } ), parse_error::at_least_two_points, 1 );
+    require_read_error( to_binary( { { 1.0, 1.0 }, { 2.0, 1.0 } } ),
+                        parse_error::first_time_not_zero, 1 );
+    require_read_error( to_binary( { { 0.0, 1.0 }, { 1.0, 1.0 }, { 1.0, 2.0 } } ),
+                        parse_error::time_not_increasing, 2 );
+}
+
+TEST_CASE( "binary missing file" ) {
+    auto result = read_breakpoints( "/nonexistent/breakpoints.bkpt" );
+    auto * error = std::get_if<parse_error>( &result );
+    REQUIRE( error );
+    CHECK( error->code == parse_error::io_error );
+}
+
+// ----------------------------------------------------------------------------------------------------
+// point_stream
+// ----------------------------------------------------------------------------------------------------
+
+static point_list drain( point_stream & stream ) {
+    point_list result;
+    while ( auto point = stream.next() )
+        result.push_back( *point );
+    return result;
+}
+
+static void require_stream_error( const std::string & contents, parse_error::errc code,
+                                  unsigned line ) {
+    temp_file file( contents );
+    point_stream stream( file.path );
+    drain( stream );
+    INFO( "Input[" << contents << "]" );
+    CHECK( stream.error().line == line );
+    CHECK( stream.error().code == code );
+}
+
+TEST_CASE( "stream reads both formats" ) {
+    for ( auto contents : { std::string( "0 -1\n\n0.5 0.25\n 1.5 3.5\n" ), to_binary( example ),
+                            to_binary( example, binary_precision::float32 ) } ) {
+        temp_file file( contents );
+        point_stream stream( file.path );
+        CHECK( drain( stream ) == example );
+        CHECK( stream.error().code == parse_error::success );
+        CHECK( !stream.next() );
+
+        stream.rewind();
+        CHECK( drain( stream ) == example );
+    }
+}
+
+TEST_CASE( "stream stops at first problem" ) {
+    temp_file file( "0 0\n1 1\n0.5 2\n3 3\n" );
+    point_stream stream( file.path );
+    CHECK( drain( stream ) == point_list{ { 0, 0 }, { 1, 1 } } );
+    CHECK( stream.error().code == parse_error::time_not_increasing );
+    CHECK( stream.error().line == 2 );
+
+    // Rewinding clears errors found while reading
+    stream.rewind();
+    CHECK( stream.error().code == parse_error::success );
+    CHECK( stream.next() );
+}
+
+TEST_CASE( "stream failures" ) {
+    require_stream_error( "", parse_error::unexpected_eof, 1 );
+    require_stream_error( "0 0\n", parse_error::at_least_two_points, 1 );
+    require_stream_error( "0 0\n\n\n", parse_error::at_least_two_points, 3 );
+    require_stream_error( "\n1 1\n2 2\n", parse_error::first_time_not_zero, 2 );
+    require_stream_error( "0 0\n1 1\n2 X\n", parse_error::misformatted_line, 3 );
+    require_stream_error( "0 0\n1 1", parse_error::unexpected_eof, 2 );
+    require_stream_error( to_binary( example ).substr( 0, 30 ), parse_error::unexpected_eof, 1 );
+    require_stream_error( to_binary( { { 0.0, 1.0 }, { 1.0, 1.0 }, { 1.0, 2.0 } } ),
+                          parse_error::time_not_increasing, 2 );
+
+    point_stream missing( "/nonexistent/breakpoints.bkpt" );
+    CHECK( !missing.next() );
+    CHECK( missing.error().code == parse_error::io_error );
+}
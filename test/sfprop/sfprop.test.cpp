@@ -0,0 +1,36 @@
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_FAST_COMPILE
+#include "catch/catch.hpp"
+#include "temp_path.hpp"
+
+#include "sfprop/sfprop.hpp"
+
+#include <filesystem>
+#include <sstream>
+#include <vector>
+
+TEST_CASE( "Calculated peak is given in file units and normalized" ) {
+    const auto path = temp_path( "sfprop_test.wav" );
+    {
+        std::vector<short> samples( 1000, 100 );
+        samples[ 123 ] = 16384;
+        samples[ 456 ] = -8192;
+        SndfileHandle out( path, SFM_WRITE, SF_FORMAT_WAV | SF_FORMAT_PCM_16, 1, 48000 );
+        REQUIRE( out.write( samples.data(), samples.size() ) == sf_count_t( samples.size() ) );
+    }
+
+    std::ostringstream os;
+    print_calculated_stats( os, path, nullptr );
+    std::filesystem::remove( path );
+
+    const auto text = os.str();
+    INFO( text );
+    CHECK( text.find( "Calculated Peak: 16384.000000 (" ) != std::string::npos );
+    CHECK( text.find( "Calc Norm Peak:  0.500000 (" ) != std::string::npos );
+}
+
+TEST_CASE( "Calculated peak of a missing file is not found" ) {
+    std::ostringstream os;
+    print_calculated_stats( os, "/nonexistent/sfprop_test.wav", nullptr );
+    CHECK( os.str() == "Calculated Peak: not found\nCalc Norm Peak:  not found\n" );
+}
@@ -0,0 +1,20 @@
+// unique names for the files tests put in the temp directory
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <string>
+
+#include <unistd.h>
+
+// A path in the temp directory for a file named like `name`, e.g. "test.wav" becomes
+// "test.<pid>.<n>.wav". Test binaries run side by side (ctest -j) then never share a file, and
+// nobody else's file of that name is touched.
+inline std::string temp_path( const std::string & name ) {
+    static std::atomic<unsigned> counter = 0;
+    const std::filesystem::path p( name );
+    const auto unique = '.' + std::to_string( ::getpid() ) + '.' + std::to_string( counter++ );
+    return ( std::filesystem::temp_directory_path()
+             / ( p.stem().string() + unique + p.extension().string() ) )
+        .string();
+}
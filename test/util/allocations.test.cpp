@@ -0,0 +1,225 @@
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_FAST_COMPILE
+#include "catch/catch.hpp"
+#include "temp_path.hpp"
+
+#include "util/sndfile_utils.hpp"
+#include "util/virtual_io.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <new>
+#include <string>
+#include <vector>
+
+// Every allocation through operator new in this program is counted, on any thread. Catch allocates
+// too, so counts are only taken around the calls being checked.
+static std::atomic<size_t> heap_allocations = 0;
+
+void * operator new( size_t size ) {
+    ++heap_allocations;
+    if ( void * p = std::malloc( size ? size : 1 ) )
+        return p;
+    throw std::bad_alloc();
+}
+
+void * operator new( size_t size, std::align_val_t alignment ) {
+    ++heap_allocations;
+    const auto align = size_t( alignment );
+    if ( void * p = std::aligned_alloc( align, ( size + align - 1 ) / align * align ) )
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete( void * p ) noexcept {
+    std::free( p );
+}
+
+void operator delete( void * p, size_t ) noexcept {
+    std::free( p );
+}
+
+void operator delete( void * p, std::align_val_t ) noexcept {
+    std::free( p );
+}
+
+void operator delete( void * p, size_t, std::align_val_t ) noexcept {
+    std::free( p );
+}
+
+namespace {
+
+// Heap allocations made while f() runs
+template <class F> size_t allocations_in( F && f ) {
+    const size_t before = heap_allocations;
+    f();
+    return heap_allocations - before;
+}
+
+// Takes whatever is written to it and keeps none of it, so that writing output doesn't allocate
+class null_stream : public sound_stream {
+public:
+    sf_count_t length() override {
+        return _length;
+    }
+
+    sf_count_t seek( sf_count_t offset, int whence ) override {
+        const sf_count_t target = seek_target( _position, _length, offset, whence );
+        if ( target >= 0 )
+            _position = target;
+        return target;
+    }
+
+    sf_count_t read( void *, sf_count_t ) override {
+        return 0;
+    }
+
+    sf_count_t write( const void *, sf_count_t count ) override {
+        _position += count;
+        _length = std::max( _length, _position );
+        return count;
+    }
+
+    sf_count_t tell() override {
+        return _position;
+    }
+
+private:
+    sf_count_t _length = 0;
+    sf_count_t _position = 0;
+};
+
+std::vector<double> make_signal( const size_t n ) {
+    std::vector<double> result( n );
+    for ( size_t i = 0; i < n; ++i )
+        result[i] = 0.5 * std::sin( double( i ) * 0.01 );
+    return result;
+}
+
+// A WAV of `frames` stereo frames of `subtype` in memory
+std::vector<std::byte> make_wav( const int subtype, const sf_count_t frames ) {
+    const auto samples = make_signal( frames * 2 );
+    memory_stream stream;
+    {
+        SndfileHandle out( sound_stream::callbacks(), &stream, SFM_WRITE, SF_FORMAT_WAV | subtype,
+                           2, 48000 );
+        REQUIRE( out.writef( samples.data(), frames ) == frames );
+    }
+    return stream.take();
+}
+
+// The same, as a file in the temp directory that is removed afterwards
+struct temp_wav {
+    temp_wav( const std::string & name, const int subtype, const sf_count_t frames ):
+        path( temp_path( name ) ) {
+        const auto samples = make_signal( frames * 2 );
+        SndfileHandle out( path, SFM_WRITE, SF_FORMAT_WAV | subtype, 2, 48000 );
+        REQUIRE( out.writef( samples.data(), frames ) == frames );
+    }
+
+    ~temp_wav() {
+        std::filesystem::remove( path );
+    }
+
+    std::string path;
+};
+
+// Opens `path` (or `bytes`, if `path` is empty) and a null output, and counts the allocations
+// made by copy(from, to), leaving out the handles' own.
+template <class F>
+size_t copy_allocations( const std::string & path, std::span<const std::byte> bytes, F && copy ) {
+    memory_view view( bytes );
+    null_stream sink;
+    auto from = path.empty() ? make_input_handle( view ) : make_input_handle( path );
+    auto to = make_output_handle( sink, from );
+    REQUIRE( from );
+    REQUIRE( to );
+
+    bool ok = false;
+    const size_t count = allocations_in( [&] { ok = copy( *from, *to ); } );
+    CHECK( ok );
+    return count;
+}
+
+} // namespace
+
+TEST_CASE( "Serial copies don't allocate once warmed up" ) {
+    for ( int subtype : { SF_FORMAT_PCM_16, SF_FORMAT_PCM_32, SF_FORMAT_FLOAT, SF_FORMAT_DOUBLE } ) {
+        const auto bytes = make_wav( subtype, 10000 );
+        auto copy = []( SndfileHandle & from, SndfileHandle & to ) {
+            return scale_copy( from, to, 0.5f );
+        };
+
+        INFO( "subtype=" << subtype );
+        copy_allocations( {}, bytes, copy );
+        CHECK( copy_allocations( {}, bytes, copy ) == 0 );
+    }
+}
+
+TEST_CASE( "Mapped copies don't allocate once warmed up" ) {
+    const temp_wav file( "allocations_test_mapped.wav", SF_FORMAT_FLOAT, 10000 );
+    auto copy = [&]( SndfileHandle & from, SndfileHandle & to ) {
+        return scale_copy( file.path, from, to, 0.5f );
+    };
+
+    copy_allocations( file.path, {}, copy );
+    CHECK( copy_allocations( file.path, {}, copy ) == 0 );
+}
+
+TEST_CASE( "Serial scans don't allocate once warmed up" ) {
+    const auto bytes = make_wav( SF_FORMAT_FLOAT, 10000 );
+    auto scan = []( SndfileHandle & from, SndfileHandle & ) {
+        return scan_chunks( from, []( std::span<const float>, sf_count_t ) {}, 1024 );
+    };
+
+    copy_allocations( {}, bytes, scan );
+    CHECK( copy_allocations( {}, bytes, scan ) == 0 );
+}
+
+// Starting threads and opening a handle per worker allocates, but nothing may be allocated per
+// block or chunk, so a long file costs as many allocations as a short one.
+TEST_CASE( "Threaded copies allocate the same for any length" ) {
+    const temp_wav short_file( "allocations_test_short.wav", SF_FORMAT_PCM_16, 5000 );
+    const temp_wav long_file( "allocations_test_long.wav", SF_FORMAT_PCM_16, 200000 );
+
+    auto pipelined = []( const std::string & ) {
+        return []( SndfileHandle & from, SndfileHandle & to ) {
+            return transform_copy_pipelined( from, to, scale_by( 0.5f ), 256 );
+        };
+    };
+    auto parallel = []( const std::string & path ) {
+        return [path]( SndfileHandle & from, SndfileHandle & to ) {
+            auto make_transform = [] {
+                return []( std::span<float> data, sf_count_t ) { scale_by( 0.5f )( data ); };
+            };
+            return transform_copy_parallel( path, from, to, make_transform, 4, 1024 );
+        };
+    };
+    auto scan = []( const std::string & path ) {
+        return [path]( SndfileHandle & from, SndfileHandle & ) {
+            return scan_chunks( path, from, []( std::span<const float>, sf_count_t ) {}, 4, 1024 );
+        };
+    };
+    auto stats = []( const std::string & path ) {
+        return [path]( SndfileHandle & from, SndfileHandle & ) {
+            return bool( scan_signal( path, from, 4, true, 1024 ) );
+        };
+    };
+
+    auto check_same = [&]( auto make_copy, const char * name ) {
+        INFO( name );
+        for ( int i = 0; i < 3; ++i )
+            copy_allocations( long_file.path, {}, make_copy( long_file.path ) );
+        const size_t short_count
+            = copy_allocations( short_file.path, {}, make_copy( short_file.path ) );
+        const size_t long_count
+            = copy_allocations( long_file.path, {}, make_copy( long_file.path ) );
+        CHECK( long_count == short_count );
+    };
+    check_same( pipelined, "pipelined" );
+    check_same( parallel, "parallel" );
+    check_same( scan, "scan" );
+    check_same( stats, "stats" );
+}
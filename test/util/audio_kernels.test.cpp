@@ -0,0 +1,262 @@
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_FAST_COMPILE
+#include "catch/catch.hpp"
+
+#include "util/audio_kernels.hpp"
+#include "util/sample_dispatch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace audio_kernels;
+using namespace Catch;
+
+static std::vector<float> make_signal( size_t n ) {
+    std::vector<float> result( n );
+    for ( size_t i = 0; i < n; ++i )
+        result[i] = float( i % 17 ) * 0.125f - 1.0f;
+    return result;
+}
+
+static const auto all_sets = { isa::scalar, isa::sse2, isa::avx2, isa::avx512, isa::best };
+
+TEST_CASE( "Gain envelope matches scalar loop" ) {
+    for ( int channels : { 1, 2, 3, 4, 6, 8 } ) {
+        // Odd frame counts exercise the tails after the vector loops
+        for ( size_t frames : { 0, 1, 3, 7, 16, 33, 250 } ) {
+            auto gains = make_signal( frames );
+            auto expected = make_signal( frames * channels );
+            for ( size_t i = 0; i < expected.size(); ++i )
+                expected[i] *= gains[i / channels];
+
+            for ( auto set : all_sets ) {
+                if ( !supports( set ) )
+                    continue;
+
+                INFO( "channels=" << channels << " frames=" << frames << " isa=" << int( set ) );
+                auto samples = make_signal( frames * channels );
+                apply_gain_envelope( samples, gains, channels, set );
+                CHECK_THAT( samples, Equals( expected ) );
+            }
+        }
+    }
+}
+
+TEST_CASE( "Ramp is identical on every instruction set" ) {
+    std::vector<float> expected( 37 );
+    for ( size_t i = 0; i < expected.size(); ++i )
+        expected[i] = float( 0.3 + 0.01 * ( 5.0 + double( i ) ) );
+
+    for ( auto set : all_sets ) {
+        if ( !supports( set ) )
+            continue;
+
+        INFO( "isa=" << int( set ) );
+        std::vector<float> out( expected.size() );
+        ramp( out, 0.3, 0.01, 5.0, set );
+        CHECK_THAT( out, Equals( expected ) );
+    }
+}
+
+TEST_CASE( "Channel peaks match scalar loop" ) {
+    for ( int channels : { 1, 2, 3, 4, 6, 8 } ) {
+        for ( size_t frames : { 0, 1, 3, 7, 16, 33, 250 } ) {
+            auto samples = make_signal( frames * channels );
+            // Put a distinct peak in each channel, away from the start of the buffer
+            for ( int c = 0; c < channels && frames > 0; ++c )
+                samples[( frames - 1 - c % frames ) * channels + c]
+                    = ( c % 2 ? 1.f : -1.f ) * ( 2.f + c );
+
+            std::vector<float> expected( channels, 0.f );
+            for ( size_t i = 0; i < samples.size(); ++i )
+                expected[i % channels] = std::max( expected[i % channels], std::abs( samples[i] ) );
+
+            for ( auto set : all_sets ) {
+                if ( !supports( set ) )
+                    continue;
+
+                INFO( "channels=" << channels << " frames=" << frames << " isa=" << int( set ) );
+                std::vector<float> peaks( channels, 0.f );
+                accumulate_peaks( samples, peaks, set );
+                CHECK_THAT( peaks, Equals( expected ) );
+            }
+        }
+    }
+}
+
+TEST_CASE( "Channel sums of squares match scalar loop" ) {
+    for ( size_t channels : { 1, 2, 3, 4, 6, 8 } ) {
+        auto samples = make_signal( 33 * channels );
+        std::vector<double> expected( channels, 1.0 );
+        for ( size_t i = 0; i < samples.size(); ++i )
+            expected[i % channels] += double( samples[i] ) * samples[i];
+
+        INFO( "channels=" << channels );
+        std::vector<double> sums( channels, 1.0 );
+        accumulate_squares( samples, sums );
+        CHECK_THAT( sums, Equals( expected ) );
+    }
+}
+
+TEST_CASE( "Common channel counts are dispatched as constants" ) {
+    for ( size_t channels = 1; channels <= 9; ++channels ) {
+        auto [value, constant] = dispatch_channels( channels, []( auto c ) {
+            return std::pair{ size_t( c ), is_channel_count_v<decltype( c )> };
+        } );
+        INFO( "channels=" << channels );
+        CHECK( value == channels );
+        CHECK( constant == ( channels <= 2 || ( channels % 2 == 0 && channels <= 8 ) ) );
+    }
+}
+
+TEST_CASE( "Integer gain rounds to nearest and saturates" ) {
+    std::vector<short> shorts{ 0, 1, -1, 3, -3, 1000, -1000, 30000, -30000, 32767, -32768 };
+    auto expected = shorts;
+    for ( auto & x : expected )
+        x = short( std::clamp( std::floor( x * 1.5 + 0.5 ), -32768.0, 32767.0 ) );
+    apply_gain( std::span<short>( shorts ), 1.5 );
+    CHECK_THAT( shorts, Equals( expected ) );
+
+    std::vector<int> ints{ 0, 7, -7, 1 << 20, -( 1 << 20 ), INT32_MAX, INT32_MIN };
+    apply_gain( std::span<int>( ints ), -0.25 );
+    CHECK_THAT( ints, Equals( std::vector<int>{ 0, -2, 2, -( 1 << 18 ), 1 << 18,
+                                                -( 1 << 29 ), 1 << 29 } ) );
+}
+
+TEST_CASE( "Unity gain leaves integers alone" ) {
+    std::vector<int> ints{ 0, 1, -1, 123456789, INT32_MAX, INT32_MIN };
+    auto expected = ints;
+    apply_gain( std::span<int>( ints ), 1.0 );
+    CHECK_THAT( ints, Equals( expected ) );
+
+    std::vector<float> gains( ints.size(), 1.f );
+    apply_gain_envelope( std::span<int>( ints ), gains, 1 );
+    CHECK_THAT( ints, Equals( expected ) );
+}
+
+TEST_CASE( "Integer gain handles zero, negative, huge and NaN gains" ) {
+    const std::vector<int> ints{ 0, 1, -1, 1000, -1000, INT32_MAX, INT32_MIN };
+    const std::vector<short> shorts{ 0, 1, -1, 1000, -1000, 32767, -32768 };
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const double inf = std::numeric_limits<double>::infinity();
+
+    auto gained = []( auto samples, double gain ) {
+        apply_gain( std::span( samples ), gain );
+        return samples;
+    };
+    auto enveloped = []( auto samples, float gain ) {
+        const std::vector<float> gains( samples.size(), gain );
+        apply_gain_envelope( std::span( samples ), gains, 1 );
+        return samples;
+    };
+
+    const std::vector<int> zeros( ints.size(), 0 );
+    CHECK_THAT( gained( ints, 0.0 ), Equals( zeros ) );
+    CHECK_THAT( enveloped( ints, 0.f ), Equals( zeros ) );
+
+    CHECK_THAT( gained( shorts, -1.0 ),
+                Equals( std::vector<short>{ 0, -1, 1, -1000, 1000, -32767, 32767 } ) );
+    CHECK_THAT( gained( ints, -3.0 ),
+                Equals( std::vector<int>{ 0, -3, 3, -3000, 3000, INT32_MIN, INT32_MAX } ) );
+
+    const std::vector<int> saturated{ 0, INT32_MAX, INT32_MIN, INT32_MAX, INT32_MIN, INT32_MAX,
+                                      INT32_MIN };
+    for ( double huge : { 0x1p31, 1e10, 1e300 } ) {
+        INFO( "gain=" << huge );
+        CHECK_THAT( gained( ints, huge ), Equals( saturated ) );
+    }
+    CHECK_THAT( enveloped( ints, 1e10f ), Equals( saturated ) );
+    CHECK_THAT( gained( shorts, -1e10 ),
+                Equals( std::vector<short>{ 0, -32768, 32767, -32768, 32767, -32768, 32767 } ) );
+
+    CHECK_THAT( gained( ints, nan ), Equals( ints ) );
+    CHECK_THAT( gained( ints, inf ), Equals( ints ) );
+    CHECK_THAT( gained( shorts, nan ), Equals( shorts ) );
+    CHECK_THAT( enveloped( ints, float( nan ) ), Equals( ints ) );
+
+    // A NaN in an envelope skips its own frame without affecting the others
+    std::vector<int> mixed{ 1000, 1000, 1000 };
+    const std::vector<float> gains{ 2.f, float( nan ), float( inf ) };
+    apply_gain_envelope( std::span( mixed ), gains, 1 );
+    CHECK_THAT( mixed, Equals( std::vector<int>{ 2000, 1000, 1000 } ) );
+}
+
+TEST_CASE( "Integer gain envelope matches float to within rounding" ) {
+    for ( size_t channels : { 1, 2, 3, 6 } ) {
+        auto signal = make_signal( 257 * channels );
+        std::vector<float> gains( 257 );
+        for ( size_t f = 0; f < gains.size(); ++f )
+            gains[f] = 2.5f * std::sin( float( f ) * 0.05f );
+
+        std::vector<short> shorts( signal.size() );
+        std::vector<double> expected( signal.size() );
+        for ( size_t i = 0; i < signal.size(); ++i ) {
+            shorts[i] = short( std::lrint( signal[i] * 12000 ) );
+            expected[i] = std::clamp( shorts[i] * double( gains[i / channels] ), -32768.0,
+                                      32767.0 );
+        }
+
+        INFO( "channels=" << channels );
+        dispatch_channels( channels, [&]( auto c ) {
+            apply_gain_envelope( std::span<short>( shorts ), gains, c );
+        } );
+        for ( size_t i = 0; i < shorts.size(); ++i )
+            CHECK( shorts[i] == Detail::Approx( expected[i] ).margin( 0.5 + 1e-6 ) );
+    }
+}
+
+TEST_CASE( "Integer gain envelope rounds every frame to nearest on its own" ) {
+    // Small gains next to a large one, which used to coarsen the whole block's fixed point
+    std::mt19937 rng( 24 );
+    std::uniform_int_distribution<int> sample( INT32_MIN, INT32_MAX );
+    std::uniform_real_distribution<float> small_gain( 0.f, 0.01f );
+
+    std::vector<int> ints( 4096 );
+    std::vector<float> gains( ints.size() );
+    for ( size_t i = 0; i < ints.size(); ++i ) {
+        ints[i] = sample( rng );
+        gains[i] = i % 64 == 0 ? 1.5f : small_gain( rng ) * ( i % 2 ? 1.f : -1.f );
+    }
+
+    // long double holds the 55-bit product of an int and a float gain exactly on x86
+    auto rounded = []( int x, float gain ) {
+        return int( std::clamp( std::floor( (long double)x * gain + 0.5L ),
+                                (long double)INT32_MIN, (long double)INT32_MAX ) );
+    };
+
+    auto together = ints;
+    apply_gain_envelope( std::span<int>( together ), gains, 1 );
+    for ( size_t i = 0; i < ints.size(); ++i ) {
+        int alone = ints[i];
+        apply_gain_envelope( std::span<int>( &alone, 1 ), std::span( &gains[i], 1 ), 1 );
+        INFO( "x=" << ints[i] << " gain=" << gains[i] );
+        CHECK( together[i] == rounded( ints[i], gains[i] ) );
+        CHECK( together[i] == alone );
+    }
+}
+
+TEST_CASE( "Files are copied in the cheapest lossless sample type" ) {
+    auto chosen = []( int from, int to ) { return choose_sample_format( from, to ); };
+    const int wav = SF_FORMAT_WAV;
+    CHECK( chosen( wav | SF_FORMAT_PCM_16, wav | SF_FORMAT_PCM_16 ) == sample_format::int16 );
+    CHECK( chosen( wav | SF_FORMAT_PCM_U8, wav | SF_FORMAT_PCM_16 ) == sample_format::int16 );
+    CHECK( chosen( wav | SF_FORMAT_PCM_24, wav | SF_FORMAT_PCM_32 ) == sample_format::int32 );
+    CHECK( chosen( wav | SF_FORMAT_PCM_32, wav | SF_FORMAT_PCM_32 ) == sample_format::int32 );
+    CHECK( chosen( wav | SF_FORMAT_PCM_16, wav | SF_FORMAT_PCM_24 ) == sample_format::float32 );
+    CHECK( chosen( wav | SF_FORMAT_PCM_24, wav | SF_FORMAT_PCM_16 ) == sample_format::float32 );
+    CHECK( chosen( wav | SF_FORMAT_PCM_16, wav | SF_FORMAT_FLOAT ) == sample_format::float32 );
+    CHECK( chosen( wav | SF_FORMAT_FLOAT, wav | SF_FORMAT_PCM_16 ) == sample_format::float32 );
+    CHECK( chosen( wav | SF_FORMAT_DOUBLE, wav | SF_FORMAT_PCM_24 ) == sample_format::float64 );
+    CHECK( chosen( wav | SF_FORMAT_FLOAT, wav | SF_FORMAT_DOUBLE ) == sample_format::float64 );
+
+    const bool is_short = dispatch_sample_format( sample_format::int16, []( auto type ) {
+        return std::is_same_v<typename decltype( type )::type, short>;
+    } );
+    CHECK( is_short );
+}
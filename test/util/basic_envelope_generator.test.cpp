@@ -0,0 +1,134 @@
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_FAST_COMPILE
+#include "catch/catch.hpp"
+#include "temp_path.hpp"
+
+#include "util/basic_envelope_generator.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+using namespace breakpoint;
+using namespace Catch;
+
+static std::vector<float> to_vector( std::span<float> span ) {
+    return std::vector<float>( span.data(), span.data() + span.size() );
+}
+
+TEST_CASE( "Empty envelope all zero" ) {
+    basic_envelope_generator gen( {}, 1, 10 );
+    CHECK_THAT( to_vector( gen.next_frames( 4 ) ), Equals( std::vector<float>{ 0, 0, 0, 0 } ) );
+}
+
+TEST_CASE( "Single point is held" ) {
+    basic_envelope_generator gen( { { 0.0, 0.5 } }, 1, 10 );
+    CHECK_THAT( to_vector( gen.next_frames( 3 ) ), Equals( std::vector<float>{ .5, .5, .5 } ) );
+    CHECK_THAT( to_vector( gen.next_frames( 5 ) ),
+                Equals( std::vector<float>{ .5, .5, .5, .5, .5 } ) );
+}
+
+TEST_CASE( "Ramp and hold last value" ) {
+    basic_envelope_generator gen( { { 0.0, 0.0 }, { 1.0, 1.0 }, { 2.0, 0.0 } }, 4, 16 );
+    CHECK_THAT( to_vector( gen.next_frames( 12 ) ),
+                Equals( std::vector<float>{ 0, .25, .5, .75, 1, .75, .5, .25, 0, 0, 0, 0 } ) );
+}
+
+TEST_CASE( "Segments split across requests" ) {
+    const point_list points{ { 0.0, 0.0 }, { 1.0, 1.0 }, { 1.5, -0.5 }, { 4.0, 0.25 } };
+    basic_envelope_generator whole( points, 10, 64 );
+    auto expected = to_vector( whole.next_frames( 50 ) );
+
+    basic_envelope_generator split( points, 10, 64 );
+    std::vector<float> actual;
+    for ( size_t n : { 1, 3, 7, 2, 11, 9, 17 } ) {
+        auto frames = to_vector( split.next_frames( n ) );
+        actual.insert( actual.end(), frames.begin(), frames.end() );
+    }
+
+    CHECK_THAT( actual, Equals( expected ) );
+}
+
+TEST_CASE( "Points on the same frame are skipped" ) {
+    // At 2 samples/sec, 0.5 and 0.7 both land on frame 1
+    basic_envelope_generator gen( { { 0.0, 0.0 }, { 0.5, 1.0 }, { 0.7, 0.5 }, { 1.5, 0.0 } }, 2,
+                                  10 );
+    CHECK_THAT( to_vector( gen.next_frames( 5 ) ),
+                Equals( std::vector<float>{ 0, .5, .25, 0, 0 } ) );
+}
+
+TEST_CASE( "Seeking matches rendering from the start" ) {
+    const point_list points{ { 0.0, 0.0 }, { 1.0, 1.0 }, { 1.5, -0.5 }, { 4.0, 0.25 } };
+    basic_envelope_generator whole( points, 10, 64 );
+    auto expected = to_vector( whole.next_frames( 50 ) );
+
+    basic_envelope_generator gen( points, 10, 64 );
+    for ( size_t start : { 30, 12, 0, 45, 7 } ) {
+        gen.seek( start );
+        auto frames = to_vector( gen.next_frames( 5 ) );
+        INFO( "start=" << start );
+        CHECK_THAT( frames, Equals( std::vector<float>( expected.begin() + start,
+                                                        expected.begin() + start + 5 ) ) );
+    }
+}
+
+TEST_CASE( "Random access over many points" ) {
+    point_list points;
+    for ( int i = 0; i < 200; ++i )
+        points.push_back( { i * 0.1, ( i % 7 ) / 7.0 } );
+    basic_envelope_generator whole( points, 100, 4096 );
+    auto expected = to_vector( whole.next_frames( 2100 ) );
+
+    basic_envelope_generator gen( points, 100, 64 );
+    for ( size_t start : { 2000, 5, 1234, 999, 1000, 0, 2036 } ) {
+        auto frames = to_vector( gen.frames_at( start, 64 ) );
+        INFO( "start=" << start );
+        CHECK_THAT( frames, Equals( std::vector<float>( expected.begin() + start,
+                                                        expected.begin() + start + 64 ) ) );
+    }
+
+    CHECK( gen.frames_at( 0, 65 ).empty() );
+}
+
+TEST_CASE( "Streamed points match points given up front" ) {
+    point_list points;
+    for ( int i = 0; i < 200; ++i )
+        points.push_back( { i * 0.1, ( i % 7 ) / 7.0 } );
+    const auto path = temp_path( "envelope_test.bkpt" );
+    REQUIRE( write_breakpoints_binary( path, points ) );
+
+    basic_envelope_generator whole( points, 100, 4096 );
+    auto expected = to_vector( whole.next_frames( 2100 ) );
+
+    basic_envelope_generator streamed( point_stream( path ), 100, 64 );
+    std::vector<float> actual;
+    for ( size_t n : { 64, 1, 30, 64, 5 } ) {
+        auto frames = to_vector( streamed.next_frames( n ) );
+        actual.insert( actual.end(), frames.begin(), frames.end() );
+    }
+    CHECK_THAT( actual, Equals( std::vector<float>( expected.begin(),
+                                                    expected.begin() + actual.size() ) ) );
+
+    // Going backwards reads the stream again
+    for ( size_t start : { 2000, 5, 1234, 999, 1000, 0, 2036 } ) {
+        auto frames = to_vector( streamed.frames_at( start, 64 ) );
+        INFO( "start=" << start );
+        CHECK_THAT( frames, Equals( std::vector<float>( expected.begin() + start,
+                                                        expected.begin() + start + 64 ) ) );
+    }
+    CHECK( streamed.error().code == parse_error::success );
+
+    std::filesystem::remove( path );
+}
+
+TEST_CASE( "Streamed envelope holds its value at a bad point" ) {
+    const auto path = temp_path( "envelope_test.txt" );
+    std::ofstream( path ) << "0 0\n2 1\n1 0\n";
+
+    basic_envelope_generator gen( point_stream( path ), 2, 10 );
+    CHECK_THAT( to_vector( gen.next_frames( 6 ) ),
+                Equals( std::vector<float>{ 0, .25, .5, .75, 1, 1 } ) );
+    CHECK( gen.error().code == parse_error::time_not_increasing );
+
+    std::filesystem::remove( path );
+}
@@ -0,0 +1,111 @@
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_FAST_COMPILE
+#include "catch/catch.hpp"
+
+#include "util/batch.hpp"
+
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE( "Manifest lines split on tabs or spaces" ) {
+    std::istringstream in( "# input output\n"
+                           "a.wav b.wav\n"
+                           "\n"
+                           "with space.wav\tout put.wav\r\n"
+                           "  c.wav   d.wav  \n" );
+    auto jobs = parse_manifest( in, 2 );
+    REQUIRE( jobs );
+    CHECK( *jobs
+           == std::vector<batch_job>{ { "a.wav", "b.wav" },
+                                      { "with space.wav", "out put.wav" },
+                                      { "c.wav", "d.wav" } } );
+}
+
+TEST_CASE( "Manifest line with the wrong number of fields is an error" ) {
+    std::istringstream in( "a.wav b.wav env.txt\nc.wav d.wav\n" );
+    CHECK( !parse_manifest( in, 3 ) );
+}
+
+TEST_CASE( "Every job runs once and failures are counted" ) {
+    std::vector<batch_job> jobs;
+    for ( int i = 0; i < 50; ++i )
+        jobs.push_back( { "in" + std::to_string( i ), std::to_string( i % 5 ) } );
+
+    for ( unsigned concurrency : { 0, 1, 4, 100 } ) {
+        std::vector<std::atomic<int>> runs( jobs.size() );
+        auto result = run_batch( jobs, concurrency, [&]( const batch_job & job ) {
+            ++runs[std::stoi( job[0].substr( 2 ) )];
+            return job[1] != "0";
+        } );
+
+        INFO( "concurrency=" << concurrency );
+        CHECK( result.succeeded == 40 );
+        CHECK( result.failed == 10 );
+        for ( auto & r : runs )
+            CHECK( r == 1 );
+    }
+}
+
+TEST_CASE( "Each job's output is printed together with its status" ) {
+    std::vector<batch_job> jobs;
+    for ( int i = 0; i < 40; ++i )
+        jobs.push_back( { std::to_string( i ) } );
+
+    std::ostringstream printed;
+    auto * original = std::cout.rdbuf( printed.rdbuf() );
+    run_batch( jobs, 4, []( const batch_job & job ) {
+        std::cout << "first " << job[0] << std::endl;
+        std::this_thread::yield();
+        std::cout << "second " << job[0] << std::endl;
+        return true;
+    } );
+    std::cout.rdbuf( original );
+
+    std::istringstream lines( printed.str() );
+    std::vector<std::string> all;
+    for ( std::string line; std::getline( lines, line ); )
+        all.push_back( line );
+
+    REQUIRE( all.size() == jobs.size() * 3 + 1 );
+    for ( size_t i = 0; i + 1 < all.size(); i += 3 ) {
+        const auto name = all[i].substr( all[i].find( ' ' ) + 1 );
+        INFO( "line " << i << ": " << all[i] );
+        CHECK( all[i] == "first " + name );
+        CHECK( all[i + 1] == "second " + name );
+        CHECK( all[i + 2].find( "] ok     " + name + " (" ) != std::string::npos );
+    }
+}
+
+TEST_CASE( "What a job's helper threads print is kept with the job" ) {
+    std::vector<batch_job> jobs;
+    for ( int i = 0; i < 40; ++i )
+        jobs.push_back( { std::to_string( i ) } );
+
+    std::ostringstream printed;
+    auto * original = std::cout.rdbuf( printed.rdbuf() );
+    run_batch( jobs, 4, []( const batch_job & job ) {
+        std::cout << "job " << job[0] << std::endl;
+        auto helper = helper_thread( [&] { std::cout << "helper " << job[0] << std::endl; } );
+        helper.join();
+        return true;
+    } );
+    std::cout.rdbuf( original );
+
+    std::istringstream lines( printed.str() );
+    std::vector<std::string> all;
+    for ( std::string line; std::getline( lines, line ); )
+        all.push_back( line );
+
+    REQUIRE( all.size() == jobs.size() * 3 + 1 );
+    for ( size_t i = 0; i + 1 < all.size(); i += 3 ) {
+        const auto name = all[i].substr( all[i].find( ' ' ) + 1 );
+        INFO( "line " << i << ": " << all[i] );
+        CHECK( all[i] == "job " + name );
+        CHECK( all[i + 1] == "helper " + name );
+        CHECK( all[i + 2].find( "] ok     " + name + " (" ) != std::string::npos );
+    }
+}
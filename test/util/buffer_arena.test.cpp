@@ -0,0 +1,90 @@
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_FAST_COMPILE
+#include "catch/catch.hpp"
+
+#include "util/buffer_arena.hpp"
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+TEST_CASE( "Leases are aligned and as big as asked for" ) {
+    buffer_arena arena;
+    for ( size_t samples : { 0, 1, 7, 1024, 6 * 1024 } ) {
+        auto floats = arena.borrow( samples );
+        INFO( "samples=" << samples );
+        CHECK( floats.size() == samples );
+        CHECK( floats.samples().size() == samples );
+        CHECK( reinterpret_cast<uintptr_t>( floats.data() ) % buffer_arena::alignment == 0 );
+    }
+}
+
+TEST_CASE( "Returned buffers are reused" ) {
+    buffer_arena arena;
+    for ( int round = 0; round < 5; ++round ) {
+        auto a = arena.borrow( 2048 );
+        auto b = arena.borrow( 1024 );
+        auto c = arena.borrow( 512 );
+    }
+    CHECK( arena.allocations() == 3 );
+}
+
+TEST_CASE( "Smallest free buffer that fits is lent" ) {
+    buffer_arena arena;
+    float * small;
+    float * large;
+    {
+        auto a = arena.borrow( 100 );
+        auto b = arena.borrow( 1000 );
+        small = a.data();
+        large = b.data();
+    }
+
+    auto fits_small = arena.borrow( 50 );
+    CHECK( fits_small.data() == small );
+    auto fits_large = arena.borrow( 50 );
+    CHECK( fits_large.data() == large );
+    auto too_big = arena.borrow( 2000 );
+    CHECK( arena.allocations() == 3 );
+}
+
+TEST_CASE( "Moving a lease hands the loan over" ) {
+    buffer_arena arena;
+    std::vector<buffer_arena::lease> leases( 3 );
+    for ( auto & l : leases )
+        l = arena.borrow( 64 );
+    auto moved = std::move( leases[0] );
+    CHECK( leases[0].data() == nullptr );
+    CHECK( moved.size() == 64 );
+
+    leases.clear();
+    auto again = arena.borrow( 64 );
+    auto another = arena.borrow( 64 );
+    CHECK( arena.allocations() == 3 );
+
+    arena.release();
+    auto fresh = arena.borrow( 64 );
+    CHECK( arena.allocations() == 4 );
+}
+
+TEST_CASE( "Threads borrowing at once don't share buffers" ) {
+    buffer_arena arena;
+    std::vector<std::thread> threads;
+    std::vector<int> failures( 4, 0 );
+    for ( int t = 0; t < 4; ++t ) {
+        threads.emplace_back( [&, t] {
+            for ( int i = 0; i < 1000; ++i ) {
+                auto floats = arena.borrow( 256 );
+                for ( auto & x : floats.samples() )
+                    x = float( t );
+                for ( auto x : floats.samples() )
+                    failures[t] += x != float( t );
+            }
+        } );
+    }
+    for ( auto & thread : threads )
+        thread.join();
+
+    CHECK( failures == std::vector<int>( 4, 0 ) );
+    CHECK( arena.allocations() <= 4 );
+}
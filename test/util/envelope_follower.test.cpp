@@ -0,0 +1,99 @@
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_FAST_COMPILE
+#include "catch/catch.hpp"
+
+#include "util/envelope_follower.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace Catch;
+
+static std::vector<float> make_signal( size_t n ) {
+    std::vector<float> result( n );
+    for ( size_t i = 0; i < n; ++i )
+        result[i] = float( std::sin( i * 0.37 ) * ( 1.0 + ( i % 13 ) ) / 14.0 );
+    return result;
+}
+
+// Measures every window from scratch, the slow way
+template <class Measure>
+static breakpoint::point_list rescan( const std::vector<float> & signal,
+                                      size_t window,
+                                      size_t hop,
+                                      Measure && measure ) {
+    breakpoint::point_list result;
+    for ( size_t start = 0; start < signal.size(); start += hop ) {
+        const size_t end = std::min( start + window, signal.size() );
+        result.push_back( { double( start ) / 10.0, measure( &signal[start], end - start ) } );
+    }
+    return result;
+}
+
+template <class Meter>
+static breakpoint::point_list slide( const std::vector<float> & signal, size_t window, size_t hop ) {
+    windowed_envelope<Meter> envelope( window, hop, 10.0 );
+    for ( auto x : signal )
+        envelope.push( x );
+    envelope.finish();
+    return envelope.points();
+}
+
+TEST_CASE( "Sliding peak matches rescanning each window" ) {
+    auto signal = make_signal( 203 );
+    auto peak = []( const float * x, size_t n ) {
+        float result = 0.f;
+        for ( size_t i = 0; i < n; ++i )
+            result = std::max( result, std::abs( x[i] ) );
+        return double( result );
+    };
+
+    for ( size_t window : { 1, 7, 16, 50 } ) {
+        for ( size_t hop : { 1, 3, 7, 16, 60 } ) {
+            INFO( "window=" << window << " hop=" << hop );
+            CHECK_THAT( slide<sliding_peak>( signal, window, hop ),
+                        Equals( rescan( signal, window, hop, peak ) ) );
+        }
+    }
+}
+
+TEST_CASE( "Sliding RMS matches rescanning each window" ) {
+    auto signal = make_signal( 203 );
+    auto rms = []( const float * x, size_t n ) {
+        double sum = 0.0;
+        for ( size_t i = 0; i < n; ++i )
+            sum += double( x[i] ) * x[i];
+        return std::sqrt( sum / n );
+    };
+
+    for ( size_t window : { 1, 7, 16, 50 } ) {
+        for ( size_t hop : { 1, 3, 7, 16, 60 } ) {
+            INFO( "window=" << window << " hop=" << hop );
+            auto actual = slide<sliding_rms>( signal, window, hop );
+            auto expected = rescan( signal, window, hop, rms );
+            REQUIRE( actual.size() == expected.size() );
+            for ( size_t i = 0; i < actual.size(); ++i ) {
+                CHECK( actual[i].time_secs == expected[i].time_secs );
+                CHECK( actual[i].value == Detail::Approx( expected[i].value ).margin( 1e-6 ) );
+            }
+        }
+    }
+}
+
+TEST_CASE( "Follower holds peaks and releases" ) {
+    followed_envelope envelope( 0.0, 1.0, 2, 4.0 );
+    for ( float x : { 0.f, 1.f, 0.f, 0.f, -0.9f, 0.f } )
+        envelope.push( x );
+
+    // Release after one second at 4 samples per second, so each sample keeps exp(-1/4)
+    const double keep = std::exp( -0.25 );
+    auto & points = envelope.points();
+    REQUIRE( points.size() == 3 );
+    CHECK( points[0].time_secs == 0.0 );
+    CHECK( points[0].value == 0.0 );
+    CHECK( points[1].time_secs == 0.5 );
+    CHECK( points[1].value == Detail::Approx( keep ) );
+    CHECK( points[2].time_secs == 1.0 );
+    CHECK( points[2].value == Detail::Approx( 0.9 ) );
+}
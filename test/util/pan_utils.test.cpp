@@ -0,0 +1,104 @@
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_FAST_COMPILE
+#include "catch/catch.hpp"
+
+#include "util/pan_utils.hpp"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+using namespace Catch;
+
+// Interpolation error bound plus float rounding
+static void require_within( const pan_law_table & table, double max_error ) {
+    const double margin = max_error + 2e-7;
+    for ( int i = -10000; i <= 10000; ++i ) {
+        const float position = float( i ) / 10000.f;
+        auto exact = constant_power_pan<double>( position );
+        auto approx = table( position );
+        INFO( "position=" << position << " max_error=" << max_error );
+        REQUIRE( std::abs( approx.left - exact.left ) <= margin );
+        REQUIRE( std::abs( approx.right - exact.right ) <= margin );
+    }
+}
+
+TEST_CASE( "Table stays within its error bound" ) {
+    for ( double max_error : { 1e-2, 1e-3, 1e-4, 1e-5, 1e-6 } )
+        require_within( pan_law_table( max_error ), max_error );
+}
+
+TEST_CASE( "Tighter bound means a bigger table" ) {
+    CHECK( pan_law_table( 1e-3 ).intervals() < pan_law_table( 1e-6 ).intervals() );
+}
+
+TEST_CASE( "Table entries are exact" ) {
+    const auto & table = pan_law_table::standard();
+    for ( float position : { -1.f, -0.5f, -0.25f, 0.f, 0.25f, 0.5f, 0.75f, 1.f } ) {
+        auto exact = constant_power_pan<float>( position );
+        auto approx = table( position );
+        INFO( "position=" << position );
+        CHECK( approx.left == exact.left );
+        CHECK( approx.right == exact.right );
+    }
+}
+
+TEST_CASE( "Positions out of range are clamped" ) {
+    const auto & table = pan_law_table::standard();
+    CHECK( table( 2.f ).right == table( 1.f ).right );
+    CHECK( table( -3.f ).left == table( -1.f ).left );
+}
+
+TEST_CASE( "NaN positions are panned to the centre" ) {
+    const auto & table = pan_law_table::standard();
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    CHECK( table( nan ).left == table( 0.f ).left );
+    CHECK( table( nan ).right == table( 0.f ).right );
+}
+
+TEST_CASE( "Batch pan matches single positions" ) {
+    const auto & table = pan_law_table::standard();
+    std::vector<float> positions{ -1.f, -0.3f, 0.f, 0.1f, 0.99f, 1.f };
+    std::vector<float> out( positions.size() * 2 );
+    table.pan( positions, out );
+    for ( size_t i = 0; i < positions.size(); ++i ) {
+        auto pair = table( positions[i] );
+        CHECK( out[i * 2] == pair.left );
+        CHECK( out[i * 2 + 1] == pair.right );
+    }
+}
+
+TEST_CASE( "Batch pan is identical on every instruction set" ) {
+    using namespace audio_kernels;
+    const pan_law_table table( 1e-4 );
+    // Odd count so the vector loop leaves a tail; a few positions out of range or NaN
+    std::vector<float> positions( 1001 );
+    for ( size_t i = 0; i < positions.size(); ++i )
+        positions[i] = -1.2f + 2.4f * float( i ) / float( positions.size() - 1 );
+    for ( size_t i : { 3, 500, 1000 } )
+        positions[i] = std::numeric_limits<float>::quiet_NaN();
+
+    std::vector<float> expected( positions.size() * 2 );
+    for ( size_t i = 0; i < positions.size(); ++i ) {
+        auto pair = table( positions[i] );
+        expected[i * 2] = pair.left;
+        expected[i * 2 + 1] = pair.right;
+    }
+
+    for ( auto set : { isa::scalar, isa::sse2, isa::avx2, isa::avx512, isa::best } ) {
+        if ( !supports( set ) )
+            continue;
+
+        INFO( "isa=" << int( set ) );
+        std::vector<float> out( expected.size() );
+        table.pan( positions, out, set );
+        CHECK_THAT( out, Equals( expected ) );
+    }
+}
+
+TEST_CASE( "Mono frames are panned into stereo in place" ) {
+    std::vector<float> buffer{ 1.f, 2.f, 4.f, 0.f, 0.f, 0.f };
+    const std::vector<float> gains{ .5f, .25f, 1.f, 0.f, .125f, 2.f };
+    pan_mono_in_place( buffer, gains, 3 );
+    CHECK_THAT( buffer, Equals( std::vector<float>{ .5f, .25f, 2.f, 0.f, .5f, 8.f } ) );
+}
@@ -0,0 +1,110 @@
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_FAST_COMPILE
+#include "catch/catch.hpp"
+#include "temp_path.hpp"
+
+#include "util/peak_cache.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using namespace Catch;
+
+// A stand-in sound file in the temp directory, removed along with its sidecar afterwards
+struct temp_file {
+    temp_file( const std::string & contents ):
+        path( temp_path( "peak_cache_test.raw" ) ) {
+        write( contents );
+    }
+
+    ~temp_file() {
+        std::filesystem::remove( path );
+        std::filesystem::remove( peak_cache::sidecar_path( path ) );
+    }
+
+    void write( const std::string & contents ) {
+        std::ofstream( path, std::ios::trunc ) << contents;
+    }
+
+    std::string path;
+};
+
+static const signal_stats example{ 1234, { 0.5f, 0.97f }, { 0.25, 0.3125 } };
+
+TEST_CASE( "Stored stats are found again" ) {
+    temp_file file( "some samples" );
+    peak_cache cache;
+    REQUIRE( !cache.lookup( file.path ) );
+    cache.store( file.path, example );
+
+    auto found = cache.lookup( file.path );
+    REQUIRE( found );
+    CHECK( found->frames == example.frames );
+    CHECK_THAT( found->peaks, Equals( example.peaks ) );
+    CHECK_THAT( found->rms, Equals( example.rms ) );
+    CHECK( found->peak() == 0.97f );
+    CHECK( cache.hits() == 1 );
+    CHECK( cache.misses() == 1 );
+}
+
+TEST_CASE( "Changed file is a miss" ) {
+    temp_file file( "some samples" );
+    peak_cache cache;
+    cache.store( file.path, example );
+    file.write( "some other samples" );
+    CHECK( !cache.lookup( file.path ) );
+}
+
+TEST_CASE( "Missing file is never cached" ) {
+    peak_cache cache;
+    const std::string path = "/nonexistent/peak_cache_test.raw";
+    cache.store( path, example );
+    CHECK( !cache.lookup( path ) );
+}
+
+TEST_CASE( "Corrupt sidecar is a miss" ) {
+    temp_file file( "some samples" );
+    peak_cache cache;
+    cache.store( file.path, example );
+
+    // Keep the header line and the file's key, but claim an absurd number of channels
+    std::string magic_line, key_line;
+    {
+        std::ifstream in( peak_cache::sidecar_path( file.path ) );
+        std::getline( in, magic_line );
+        std::getline( in, key_line );
+    }
+    const auto key = key_line.substr( 0, key_line.rfind( ' ' ) );
+    for ( std::string channels : { "1000000000000", "0", "-1", "two" } ) {
+        std::ofstream( peak_cache::sidecar_path( file.path ), std::ios::trunc )
+            << magic_line << '\n'
+            << key << ' ' << channels << '\n';
+        INFO( "channels=" << channels );
+        CHECK( !cache.lookup( file.path ) );
+    }
+
+    // Frames count is right before the channels
+    std::ofstream( peak_cache::sidecar_path( file.path ), std::ios::trunc )
+        << magic_line << '\n'
+        << key_line.substr( 0, key.rfind( ' ' ) ) << " -5 2\n0.5 0.25\n0.5 0.25\n";
+    CHECK( !cache.lookup( file.path ) );
+}
+
+TEST_CASE( "Failed store leaves no temporary file behind" ) {
+    temp_file file( "some samples" );
+    // A directory in the sidecar's place makes the final rename fail
+    const auto sidecar = std::filesystem::path( peak_cache::sidecar_path( file.path ) );
+    std::filesystem::create_directory( sidecar );
+
+    peak_cache cache;
+    cache.store( file.path, example );
+    CHECK( !cache.lookup( file.path ) );
+
+    const auto prefix = sidecar.filename().string() + ".";
+    for ( const auto & entry : std::filesystem::directory_iterator( sidecar.parent_path() ) ) {
+        const auto name = entry.path().filename().string();
+        INFO( "name=" << name );
+        CHECK( !( name.starts_with( prefix ) && name.ends_with( ".tmp" ) ) );
+    }
+}
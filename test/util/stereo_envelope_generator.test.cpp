@@ -110,3 +110,14 @@ TEST_CASE( "Interpolation and back" ) {
                     three_qtr.right, 0.f, 1.f, three_qtr.left, three_qtr.right, half.left,
                     half.right, qtr.left, qtr.right, rtdt, rtdt } );
 }
+
+TEST_CASE( "Generator keeps its own pan law" ) {
+    // The table is a temporary, gone by the time frames are rendered
+    stereo_envelope_generator gen( { { 0.0, 0.0 }, { 1.0, 1.0 } }, 4, 10, pan_law_table( 1e-3 ) );
+    auto span = gen.next_frames( 5 );
+
+    const pan_law_table expected( 1e-3 );
+    auto half = expected( 0.5f );
+    CHECK( span[4] == half.left );
+    CHECK( span[5] == half.right );
+}
@@ -0,0 +1,255 @@
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_FAST_COMPILE
+#include "catch/catch.hpp"
+#include "temp_path.hpp"
+
+#include "breakpoint/breakpoint.hpp"
+#include "util/audio_kernels.hpp"
+#include "util/basic_envelope_generator.hpp"
+#include "util/sample_dispatch.hpp"
+#include "util/sndfile_utils.hpp"
+#include "util/virtual_io.hpp"
+
+#include <cmath>
+#include <filesystem>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+std::vector<float> make_signal( const size_t n ) {
+    std::vector<float> result( n );
+    for ( size_t i = 0; i < n; ++i )
+        result[i] = float( 0.5 * std::sin( double( i ) * 0.01 ) );
+    return result;
+}
+
+// A float WAV of `samples` in memory
+memory_stream write_wav( const std::vector<float> & samples, const int channels ) {
+    memory_stream stream;
+    SndfileHandle out( sound_stream::callbacks(), &stream, SFM_WRITE,
+                       SF_FORMAT_WAV | SF_FORMAT_FLOAT, channels, 48000 );
+    REQUIRE( out.error() == SF_ERR_NO_ERROR );
+    REQUIRE( out.writef( samples.data(), samples.size() / channels )
+             == sf_count_t( samples.size() / channels ) );
+    return stream;
+}
+
+// Takes the first `capacity` bytes written to it and refuses the rest, like a full disk
+class limited_stream : public memory_stream {
+public:
+    explicit limited_stream( sf_count_t capacity ) noexcept: _capacity( capacity ) {
+    }
+
+    sf_count_t write( const void * ptr, sf_count_t count ) override {
+        count = std::clamp<sf_count_t>( _capacity - tell(), 0, count );
+        return memory_stream::write( ptr, count );
+    }
+
+private:
+    sf_count_t _capacity;
+};
+
+// Fails every write by throwing, as a stream whose buffer can't grow might
+class throwing_stream : public memory_stream {
+public:
+    sf_count_t write( const void *, sf_count_t ) override {
+        throw std::bad_alloc();
+    }
+};
+
+} // namespace
+
+TEST_CASE( "Memory streams seek, read and write like files" ) {
+    memory_stream stream;
+    const char text[] = "abcdef";
+    CHECK( stream.write( text, 6 ) == 6 );
+    CHECK( stream.tell() == 6 );
+    CHECK( stream.length() == 6 );
+
+    CHECK( stream.seek( 8, SEEK_SET ) == 8 );
+    CHECK( stream.write( "g", 1 ) == 1 );
+    CHECK( stream.length() == 9 );
+    CHECK( stream.bytes()[6] == std::byte( 0 ) );
+
+    CHECK( stream.seek( -3, SEEK_END ) == 6 );
+    CHECK( stream.seek( -1, SEEK_CUR ) == 5 );
+    CHECK( stream.seek( -10, SEEK_CUR ) == -1 );
+    CHECK( stream.tell() == 5 );
+
+    char buffer[8] = {};
+    CHECK( stream.read( buffer, 8 ) == 4 );
+    CHECK( buffer[0] == 'f' );
+    CHECK( stream.read( buffer, 8 ) == 0 );
+}
+
+TEST_CASE( "Memory views read without writing" ) {
+    const std::byte bytes[] = { std::byte( 1 ), std::byte( 2 ), std::byte( 3 ) };
+    memory_view view( bytes );
+    CHECK( view.write( bytes, 1 ) == 0 );
+    CHECK( view.seek( 1, SEEK_SET ) == 1 );
+
+    std::byte buffer[4];
+    CHECK( view.read( buffer, 4 ) == 2 );
+    CHECK( buffer[0] == std::byte( 2 ) );
+}
+
+TEST_CASE( "Sound files round trip through memory" ) {
+    const int channels = 2;
+    const auto samples = make_signal( 3000 * channels );
+    const auto bytes = write_wav( samples, channels ).take();
+
+    memory_view view( bytes );
+    auto from = make_input_handle( view );
+    REQUIRE( from );
+    CHECK( from->channels() == channels );
+    CHECK( from->samplerate() == 48000 );
+    CHECK( from->frames() == 3000 );
+
+    std::vector<float> read( samples.size() );
+    CHECK( from->readf( read.data(), 3000 ) == 3000 );
+    CHECK( read == samples );
+}
+
+TEST_CASE( "Tools' copies run from memory to memory" ) {
+    const int channels = 2;
+    const auto samples = make_signal( 5000 * channels );
+    auto input = write_wav( samples, channels );
+    input.seek( 0, SEEK_SET );
+
+    memory_stream output;
+    {
+        auto from = make_input_handle( input );
+        auto to = make_output_handle( output, from );
+        REQUIRE( from );
+        REQUIRE( to );
+        CHECK( scale_copy( *from, *to, 0.5f ) );
+    }
+
+    memory_view view( output.bytes() );
+    auto result = make_input_handle( view );
+    REQUIRE( result );
+    REQUIRE( result->frames() == 5000 );
+
+    std::vector<float> peaks( channels, 0.f );
+    sf_count_t next_frame = 0;
+    auto measure = [&]( std::span<const float> block, sf_count_t first_frame ) {
+        CHECK( first_frame == next_frame );
+        next_frame += block.size() / channels;
+        audio_kernels::accumulate_peaks( block, peaks );
+    };
+    CHECK( scan_chunks( *result, measure, 1024 ) );
+    CHECK( next_frame == 5000 );
+    for ( auto peak : peaks )
+        CHECK( peak == Approx( 0.25 ).epsilon( 0.001 ) );
+}
+
+TEST_CASE( "Mapped copies report short writes" ) {
+    const int channels = 2;
+    const auto samples = make_signal( 5000 * channels );
+    const auto path = temp_path( "virtual_io_test.wav" );
+    {
+        SndfileHandle out( path, SFM_WRITE, SF_FORMAT_WAV | SF_FORMAT_FLOAT, channels, 48000 );
+        REQUIRE( out.writef( samples.data(), 5000 ) == 5000 );
+    }
+
+    auto copy_to = [&]( sound_stream & output ) {
+        auto from = make_input_handle( path );
+        auto to = make_output_handle( output, from );
+        REQUIRE( from );
+        REQUIRE( to );
+        return scale_copy( path, *from, *to, 0.5f );
+    };
+
+    memory_stream whole;
+    CHECK( copy_to( whole ) );
+    limited_stream full( 4096 );
+    CHECK( !copy_to( full ) );
+    std::filesystem::remove( path );
+}
+
+TEST_CASE( "Parallel copies of integer files match serial copies" ) {
+    const int channels = 2;
+    const auto samples = make_signal( 10000 * channels );
+    const auto path = temp_path( "virtual_io_parallel.wav" );
+
+    // Peaks at 1.0 with quiet stretches in between, as a normalized envelope would. The serial copy
+    // renders it in blocks of 1024 frames and the parallel one in chunks of 4000, so the two only
+    // match if each frame's gain is applied the same way whatever else is in its block.
+    const std::vector<breakpoint::point> envelope{
+        { 0.0, 0.0 }, { 0.05, 1.0 }, { 0.1, 0.01 }, { 0.15, 0.003 }, { 0.2, 1.0 }
+    };
+
+    for ( int subtype : { SF_FORMAT_PCM_16, SF_FORMAT_PCM_32 } ) {
+        INFO( "subtype=" << subtype );
+        {
+            SndfileHandle out( path, SFM_WRITE, SF_FORMAT_WAV | subtype, channels, 48000 );
+            REQUIRE( out.writef( samples.data(), 10000 ) == 10000 );
+        }
+
+        auto copy = [&]( auto && copy_func ) {
+            memory_stream result;
+            auto from = make_input_handle( path );
+            auto to = make_output_handle( result, from );
+            REQUIRE( from );
+            REQUIRE( to );
+            CHECK( dispatch_sample_format( from->format(), to->format(), [&]( auto type ) {
+                return copy_func( type, *from, *to );
+            } ) );
+            return result.take();
+        };
+
+        auto scaled_serial = copy( []( auto, SndfileHandle & from, SndfileHandle & to ) {
+            return scale_copy( from, to, 0.7f );
+        } );
+        auto scaled_parallel = copy( [&]( auto type, SndfileHandle & from, SndfileHandle & to ) {
+            using Sample = typename decltype( type )::type;
+            auto make_transform = [] {
+                return []( auto data, sf_count_t ) { scale_by( 0.7f )( data ); };
+            };
+            return transform_copy_parallel<Sample>( path, from, to, make_transform, 4, 1000 );
+        } );
+        CHECK( scaled_parallel == scaled_serial );
+
+        auto enveloped_serial = copy( [&]( auto type, SndfileHandle & from, SndfileHandle & to ) {
+            using Sample = typename decltype( type )::type;
+            basic_envelope_generator gen( envelope, from.samplerate(), 1024 );
+            auto apply = [&]( auto data ) {
+                audio_kernels::apply_gain_envelope(
+                    data, gen.next_frames( data.size() / channels ), channels );
+            };
+            return transform_copy<Sample>( from, to, apply, 1024 );
+        } );
+        auto enveloped_parallel = copy( [&]( auto type, SndfileHandle & from, SndfileHandle & to ) {
+            using Sample = typename decltype( type )::type;
+            auto make_transform = [&] {
+                auto gen = std::make_unique<basic_envelope_generator>( envelope, from.samplerate(),
+                                                                       4000 );
+                return [&, gen = std::move( gen )]( auto data, sf_count_t first_frame ) {
+                    audio_kernels::apply_gain_envelope(
+                        data, gen->frames_at( first_frame, data.size() / channels ), channels );
+                };
+            };
+            return transform_copy_parallel<Sample>( path, from, to, make_transform, 4, 4000 );
+        } );
+        CHECK( enveloped_parallel == enveloped_serial );
+        CHECK( enveloped_parallel != scaled_parallel );
+    }
+    std::filesystem::remove( path );
+}
+
+TEST_CASE( "Streams that throw fail their writes instead of unwinding through libsndfile" ) {
+    throwing_stream stream;
+    const auto samples = make_signal( 1000 );
+    SndfileHandle out( sound_stream::callbacks(), &stream, SFM_WRITE,
+                       SF_FORMAT_WAV | SF_FORMAT_FLOAT, 1, 48000 );
+    CHECK( ( out.error() != SF_ERR_NO_ERROR || out.write( samples.data(), 1000 ) < 1000 ) );
+}
+
+TEST_CASE( "Unreadable streams are reported" ) {
+    memory_stream empty;
+    CHECK( !make_input_handle( empty ) );
+}
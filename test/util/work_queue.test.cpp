@@ -0,0 +1,64 @@
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_FAST_COMPILE
+#include "catch/catch.hpp"
+
+#include "util/work_queue.hpp"
+
+#include <optional>
+#include <thread>
+#include <vector>
+
+TEST_CASE( "Items come out in the order they went in" ) {
+    work_queue<int> queue;
+    for ( int i = 0; i < 5; ++i )
+        queue.push( i );
+    queue.close();
+
+    for ( int i = 0; i < 5; ++i )
+        REQUIRE( queue.pop() == i );
+    REQUIRE( !queue.pop() );
+}
+
+TEST_CASE( "Consumer sees everything a producer thread pushes" ) {
+    work_queue<int> queue;
+    std::thread producer( [&queue] {
+        for ( int i = 0; i < 10000; ++i )
+            queue.push( i );
+        queue.close();
+    } );
+
+    std::vector<int> received;
+    while ( auto item = queue.pop() )
+        received.push_back( *item );
+    producer.join();
+
+    REQUIRE( received.size() == 10000 );
+    for ( int i = 0; i < 10000; ++i )
+        REQUIRE( received[i] == i );
+}
+
+TEST_CASE( "Closing wakes a waiting consumer" ) {
+    work_queue<int> queue;
+    std::optional<int> popped = 0;
+    std::thread consumer( [&] { popped = queue.pop(); } );
+    queue.close();
+    consumer.join();
+    REQUIRE( !popped );
+}
+
+TEST_CASE( "Queue keeps its order as it grows" ) {
+    work_queue<int> queue( 2 );
+    int next_in = 0;
+    int next_out = 0;
+    // Wrap around the ring before it has to grow, then keep it partly full while it does
+    for ( int round = 1; round <= 20; ++round ) {
+        for ( int i = 0; i < round; ++i )
+            queue.push( next_in++ );
+        for ( int i = 0; i < round / 2 + 1 && next_out < next_in; ++i )
+            REQUIRE( queue.pop() == next_out++ );
+    }
+    queue.close();
+    while ( auto item = queue.pop() )
+        REQUIRE( *item == next_out++ );
+    REQUIRE( next_out == next_in );
+}